@@ -1,12 +1,18 @@
 #include "devices/disk.h"
 #include <ctype.h>
 #include <debug.h>
+#include <round.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/palloc.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -32,6 +38,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,8 +54,53 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* PCI bus-master IDE registers, as offsets from a channel's
+   bus-master base port (see [SFF-8038i]). */
+#define BM_COMMAND 0            /* Command. */
+#define BM_STATUS 2             /* Status. */
+#define BM_PRDT 4               /* PRD table physical address. */
+
+/* Bus-master command register bits. */
+#define BMC_START 0x01          /* Start/stop bus master. */
+#define BMC_READ 0x08           /* 1=write to memory (disk read). */
+
+/* Bus-master status register bits. */
+#define BMS_ACTIVE 0x01         /* Bus master active. */
+#define BMS_ERROR 0x02          /* DMA error (write 1 to clear). */
+#define BMS_INTR 0x04           /* Interrupt (write 1 to clear). */
+
+/* A physical region descriptor.  A PRD table is an array of these
+   describing the memory for one DMA transfer; each region must be
+   word-aligned and must not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size in bytes, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_MAX (PGSIZE / sizeof (struct prd))
+
+/* PCI configuration space access. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Largest sector count a single READ/WRITE SECTOR command can
+   transfer.  A count of 0 in the Sector Count register means 256. */
+#define MAX_SECTORS_PER_CMD 256
 
-/* An ATA device. */
+/* Largest number of sectors per interrupt we ask for with SET
+   MULTIPLE MODE.  A page's worth keeps each block short enough
+   that one PIO burst does not hold off interrupts for long. */
+#define MAX_MULTIPLE (4096 / DISK_SECTOR_SIZE)
+
+/* An ATA device, or a RAM disk standing in for one. */
 struct disk 
   {
     char name[8];               /* Name, e.g. "hd0:1". */
@@ -56,10 +108,16 @@ struct disk
     int dev_no;                 /* Device 0 or 1 for master or slave. */
 
     bool is_ata;                /* 1=This device is an ATA disk. */
+    uint8_t **ram;              /* RAM disk pages, or null if not a RAM
+                                   disk. */
     disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+    int multiple;               /* Sectors per READ/WRITE MULTIPLE block,
+                                   or 0 if that mode is not in use. */
+    bool dma;                   /* Supports DMA transfers? */
+    disk_sector_t head;         /* Sector after the last one accessed. */
 
-    long long read_cnt;         /* Number of sectors read. */
-    long long write_cnt;        /* Number of sectors written. */
+    struct disk_stat stats;     /* Statistics, protected by the
+                                   channel's queue_lock. */
   };
 
 /* An ATA channel (aka controller).
@@ -75,6 +133,13 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus-master base port, 0 if no DMA. */
+    struct prd *prdt;           /* PRD table (one page). */
+
+    struct lock queue_lock;     /* Protects queue. */
+    struct list queue;          /* Pending struct disk_requests. */
+    struct condition queue_nonempty;    /* Signaled on disk_submit(). */
+
     struct disk devices[2];     /* The devices on this channel. */
   };
 
@@ -82,14 +147,40 @@ struct channel
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* Use bus-master DMA where the controller supports it?
+   Set by disk_enable_dma(), before disk_init(). */
+static bool use_dma;
+
+/* Sizes, in sectors, of RAM disks to put in place of each device,
+   or 0 to use the real device.  Set by disk_use_ram(), before
+   disk_init(). */
+static disk_sector_t ram_sectors[CHANNEL_CNT][2];
+
+/* Number of sectors in a RAM disk page. */
+#define RAM_PAGE_SECTORS (PGSIZE / DISK_SECTOR_SIZE)
+
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
-
-static void select_sector (struct disk *, disk_sector_t);
+static void set_multiple_mode (struct disk *, int max);
+static void init_ram_disk (struct disk *, disk_sector_t);
+static void ram_transfer (struct disk_request *);
+static uint16_t find_bus_master (void);
+static void transfer_sync (struct disk *, disk_sector_t, void *, size_t cnt,
+                           bool write, enum disk_io_class);
+static void account_command (struct disk *, uint64_t latency);
+static void account_request (struct disk_request *, uint64_t end);
+static inline uint64_t rdtsc (void);
+static void channel_thread (void *);
+static void pio_transfer (struct disk *, disk_sector_t, struct list *,
+                          size_t cnt, bool write);
+static bool dma_transfer (struct disk *, disk_sector_t, struct list *,
+                          size_t cnt, bool write);
+
+static void select_sectors (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
 
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
@@ -102,6 +193,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 disk_init (void) 
 {
+  uint16_t bm_base = use_dma ? find_bus_master () : 0;
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -125,21 +217,39 @@ disk_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      lock_init (&c->queue_lock);
+      list_init (&c->queue);
+      cond_init (&c->queue_nonempty);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* The primary channel's bus-master registers come first,
+         the secondary's 8 ports later. */
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         {
           struct disk *d = &c->devices[dev_no];
-          snprintf (d->name, sizeof d->name, "%s:%d", c->name, dev_no);
+          snprintf (d->name, sizeof d->name, "hd%zu:%d", chan_no, dev_no);
           d->channel = c;
           d->dev_no = dev_no;
 
           d->is_ata = false;
+          d->ram = NULL;
           d->capacity = 0;
+          d->multiple = 0;
+          d->dma = false;
+          d->head = 0;
 
-          d->read_cnt = d->write_cnt = 0;
+          memset (&d->stats, 0, sizeof d->stats);
         }
 
       /* Register interrupt handler. */
@@ -156,13 +266,29 @@ disk_init (void)
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
+
+      /* Replace devices by RAM disks as requested. */
+      for (dev_no = 0; dev_no < 2; dev_no++)
+        if (ram_sectors[chan_no][dev_no] > 0)
+          init_ram_disk (&c->devices[dev_no], ram_sectors[chan_no][dev_no]);
+
+      /* Start the thread that serves the channel's requests. */
+      if (c->devices[0].is_ata || c->devices[1].is_ata)
+        if (thread_create (c->name, PRI_DEFAULT, channel_thread, c)
+            == TID_ERROR)
+          PANIC ("%s: can't create I/O thread", c->name);
     }
 }
 
-/* Prints disk statistics. */
+/* Prints disk statistics: sector counts, a histogram of command
+   latencies in CPU cycles, queue depths, and request wait (from
+   submission to dispatch) and service times broken down by
+   caller. */
 void
 disk_print_stats (void) 
 {
+  static const char *class_names[DISK_IO_CLASS_CNT] =
+    { "other", "data", "metadata", "swap" };
   int chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) 
@@ -172,13 +298,56 @@ disk_print_stats (void)
       for (dev_no = 0; dev_no < 2; dev_no++) 
         {
           struct disk *d = disk_get (chan_no, dev_no);
-          if (d != NULL && d->is_ata) 
-            printf ("%s: %lld reads, %lld writes\n",
-                    d->name, d->read_cnt, d->write_cnt);
+          struct disk_stat st;
+          int i;
+
+          if (d == NULL)
+            continue;
+          disk_get_stats (d, &st);
+          printf ("%s: %llu reads, %llu writes%s\n",
+                  d->name, st.read_cnt, st.write_cnt,
+                  d->ram != NULL ? " (RAM disk)" : "");
+          if (st.commands == 0)
+            continue;
+
+          printf ("%s: %llu commands, queue depth avg %llu max %"PRIu32"\n",
+                  d->name, st.commands,
+                  st.queue_depth_sum / st.commands, st.queue_depth_max);
+          printf ("%s: latency (cycles):", d->name);
+          for (i = 0; i < DISK_LATENCY_BUCKETS; i++)
+            if (st.latency[i] > 0)
+              printf (" 2^%d:%llu", i, st.latency[i]);
+          printf ("\n");
+          for (i = 0; i < DISK_IO_CLASS_CNT; i++) 
+            {
+              struct disk_class_stat *cs = &st.class[i];
+              if (cs->requests == 0)
+                continue;
+              printf ("%s: %s: %llu requests, %llu sectors, "
+                      "avg wait %llu, avg service %llu cycles\n",
+                      d->name, class_names[i], cs->requests, cs->sectors,
+                      cs->wait_cycles / cs->requests,
+                      cs->service_cycles / cs->requests);
+            }
         }
     }
 }
 
+/* Copies disk D's statistics into *ST.  May be called at any
+   time. */
+void
+disk_get_stats (struct disk *d, struct disk_stat *st) 
+{
+  struct channel *c;
+
+  ASSERT (d != NULL);
+
+  c = d->channel;
+  lock_acquire (&c->queue_lock);
+  *st = d->stats;
+  lock_release (&c->queue_lock);
+}
+
 /* Returns the disk numbered DEV_NO--either 0 or 1 for master or
    slave, respectively--within the channel numbered CHAN_NO.
 
@@ -196,7 +365,7 @@ disk_get (int chan_no, int dev_no)
   if (chan_no < (int) CHANNEL_CNT) 
     {
       struct disk *d = &channels[chan_no].devices[dev_no];
-      if (d->is_ata)
+      if (d->is_ata || d->ram != NULL)
         return d; 
     }
   return NULL;
@@ -219,22 +388,7 @@ disk_size (struct disk *d)
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
 {
-  struct channel *c;
-  
-  ASSERT (d != NULL);
-  ASSERT (buffer != NULL);
-
-  c = d->channel;
-
-	lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  d->read_cnt++;
-	lock_release (&c->lock);
+  disk_read_multiple (d, sec_no, buffer, 1, DISK_IO_OTHER);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -245,24 +399,584 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
 {
+  disk_write_multiple (d, sec_no, buffer, 1, DISK_IO_OTHER);
+}
+
+/* Reads CNT consecutive sectors, starting at SEC_NO, from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  The run is read with as few commands as the sector
+   count register allows.  Returns once all the data is in BUFFER.
+   The request is accounted to CLASS in the disk's statistics.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer,
+                    size_t cnt, enum disk_io_class class) 
+{
+  transfer_sync (d, sec_no, buffer, cnt, false, class);
+}
+
+/* Writes CNT consecutive sectors, starting at SEC_NO, to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Unlike CNT calls to disk_write(), the whole run goes out in as
+   few commands as the sector count register allows.
+   Returns after the disk has acknowledged receiving all the data.
+   The request is accounted to CLASS in the disk's statistics.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+                     const void *buffer, size_t cnt,
+                     enum disk_io_class class)
+{
+  transfer_sync (d, sec_no, (void *) buffer, cnt, true, class);
+}
+
+/* Enables bus-master DMA for disks on controllers that support
+   it.  Must be called before disk_init(). */
+void
+disk_enable_dma (void) 
+{
+  use_dma = true;
+}
+
+/* Makes the device numbered DEV_NO within channel CHAN_NO (see
+   disk_get()) a RAM disk of KB kilobytes, in place of whatever
+   disk is attached there.  A RAM disk starts out zeroed and its
+   contents are lost at shutdown, so a file system on one must be
+   formatted at boot.  Must be called before disk_init(). */
+void
+disk_use_ram (int chan_no, int dev_no, size_t kb) 
+{
+  ASSERT (chan_no >= 0 && chan_no < (int) CHANNEL_CNT);
+  ASSERT (dev_no == 0 || dev_no == 1);
+
+  ram_sectors[chan_no][dev_no] = kb * (1024 / DISK_SECTOR_SIZE);
+}
+
+/* Queues request R, whose DISK, SEC_NO, BUFFER, CNT, WRITE, CLASS,
+   COMPLETE, and AUX members the caller must have filled in, and
+   returns without waiting for it.  Requests on a channel are
+   served by its I/O thread in C-SCAN order, and requests for
+   adjacent sectors in the same direction are merged into a single
+   command.  Once the whole transfer has completed, R->COMPLETE is
+   called (from the I/O thread) with R; the driver does not touch R
+   after that.  BUFFER must be kernel memory, since the I/O thread
+   does not have the submitter's user address space, and must stay
+   valid until then.
+   Requests for a RAM disk are carried out, and R->COMPLETE called,
+   before disk_submit() returns. */
+void
+disk_submit (struct disk_request *r) 
+{
+  struct disk_stat *st;
   struct channel *c;
-  
+  uint32_t depth;
+
+  ASSERT (r != NULL);
+  ASSERT (r->disk != NULL);
+  ASSERT (r->buffer != NULL);
+  ASSERT (is_kernel_vaddr (r->buffer));
+  ASSERT (r->cnt > 0);
+  ASSERT (r->sec_no + r->cnt <= r->disk->capacity);
+
+  ASSERT (r->class < DISK_IO_CLASS_CNT);
+
+  r->done = 0;
+  r->submit_tsc = r->start_tsc = rdtsc ();
+  if (r->disk->ram != NULL)
+    {
+      ram_transfer (r);
+      r->complete (r);
+      return;
+    }
+
+  c = r->disk->channel;
+  st = &r->disk->stats;
+  lock_acquire (&c->queue_lock);
+  depth = list_size (&c->queue);
+  st->queue_depth_sum += depth;
+  if (depth > st->queue_depth_max)
+    st->queue_depth_max = depth;
+  list_push_back (&c->queue, &r->elem);
+  cond_signal (&c->queue_nonempty, &c->queue_lock);
+  lock_release (&c->queue_lock);
+}
+
+/* Completion callback for transfer_sync(). */
+static void
+wake_submitter (struct disk_request *r) 
+{
+  sema_up (r->aux);
+}
+
+/* Submits a request to transfer CNT sectors at SEC_NO between disk
+   D and BUFFER and waits for it to complete. */
+static void
+transfer_sync (struct disk *d, disk_sector_t sec_no, void *buffer,
+               size_t cnt, bool write, enum disk_io_class class) 
+{
+  struct disk_request r;
+  struct semaphore done;
+
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
 
-  c = d->channel;
+  sema_init (&done, 0);
+  r.disk = d;
+  r.sec_no = sec_no;
+  r.buffer = buffer;
+  r.cnt = cnt;
+  r.write = write;
+  r.class = class;
+  r.complete = wake_submitter;
+  r.aux = &done;
+  disk_submit (&r);
+  sema_down (&done);
+}
 
-	lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-  d->write_cnt++;
-	lock_release (&c->lock);
+/* RAM disks. */
+
+/* Makes D a RAM disk of CNT sectors (rounded up to whole pages).
+   The pages need not be contiguous, so even a large RAM disk can
+   be allocated from a fragmented pool. */
+static void
+init_ram_disk (struct disk *d, disk_sector_t cnt) 
+{
+  size_t page_cnt = DIV_ROUND_UP (cnt, RAM_PAGE_SECTORS);
+  size_t i;
+
+  d->ram = malloc (page_cnt * sizeof *d->ram);
+  if (d->ram == NULL)
+    PANIC ("%s: out of memory for RAM disk", d->name);
+  for (i = 0; i < page_cnt; i++)
+    {
+      d->ram[i] = palloc_get_page (PAL_ZERO);
+      if (d->ram[i] == NULL)
+        PANIC ("%s: out of memory for %'zu kB RAM disk",
+               d->name, page_cnt * PGSIZE / 1024);
+    }
+  d->is_ata = false;
+  d->dma = false;
+  d->capacity = page_cnt * RAM_PAGE_SECTORS;
+  printf ("%s: using %'zu kB RAM disk\n", d->name, page_cnt * PGSIZE / 1024);
 }
-
+
+/* Carries out request R, which is for a RAM disk, by copying. */
+static void
+ram_transfer (struct disk_request *r) 
+{
+  struct disk *d = r->disk;
+  uint8_t *buffer = r->buffer;
+  size_t i;
+
+  for (i = 0; i < r->cnt; i++, buffer += DISK_SECTOR_SIZE)
+    {
+      disk_sector_t sec_no = r->sec_no + i;
+      uint8_t *sector = d->ram[sec_no / RAM_PAGE_SECTORS]
+                        + sec_no % RAM_PAGE_SECTORS * DISK_SECTOR_SIZE;
+
+      if (r->write)
+        memcpy (sector, buffer, DISK_SECTOR_SIZE);
+      else
+        memcpy (buffer, sector, DISK_SECTOR_SIZE);
+    }
+  r->done = r->cnt;
+
+  /* Account as the channel thread does for real disks. */
+  lock_acquire (&d->channel->queue_lock);
+  account_command (d, rdtsc () - r->start_tsc);
+  account_request (r, rdtsc ());
+  lock_release (&d->channel->queue_lock);
+}
+
+/* Request scheduling. */
+
+/* Returns the next sector request R still has to transfer. */
+static inline disk_sector_t
+next_sector (const struct disk_request *r) 
+{
+  return r->sec_no + r->done;
+}
+
+/* Picks the next request to serve from channel C's queue, in
+   C-SCAN order: the request with the lowest sector at or beyond
+   its disk's head position, or, if there is none, the lowest
+   sector overall (the head sweeps back to the start).
+   The caller must hold C's queue lock and the queue must not be
+   empty. */
+static struct disk_request *
+cscan_next (struct channel *c) 
+{
+  struct disk_request *ahead = NULL, *lowest = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct disk_request *r = list_entry (e, struct disk_request, elem);
+      disk_sector_t pos = next_sector (r);
+
+      if (pos >= r->disk->head
+          && (ahead == NULL || pos < next_sector (ahead)))
+        ahead = r;
+      if (lowest == NULL || pos < next_sector (lowest))
+        lowest = r;
+    }
+  return ahead != NULL ? ahead : lowest;
+}
+
+/* Removes the next request from channel C's queue, plus any queued
+   requests that continue it on consecutive sectors in the same
+   direction, and puts them in order on BATCH with their XFER
+   members set, for a single command of at most
+   MAX_SECTORS_PER_CMD sectors.  A request too large for one
+   command is served in pieces and stays in the queue until its
+   last piece.  Returns the number of sectors in the batch.
+   The caller must hold C's queue lock. */
+static size_t
+take_batch (struct channel *c, struct list *batch) 
+{
+  struct disk_request *first = cscan_next (c);
+  size_t left = first->cnt - first->done;
+  size_t total;
+  bool merged = true;
+
+  if (left > MAX_SECTORS_PER_CMD)
+    {
+      first->xfer = MAX_SECTORS_PER_CMD;
+      list_push_back (batch, &first->batch_elem);
+      return MAX_SECTORS_PER_CMD;
+    }
+
+  list_remove (&first->elem);
+  first->xfer = left;
+  list_push_back (batch, &first->batch_elem);
+  total = left;
+
+  while (merged) 
+    {
+      struct list_elem *e;
+
+      merged = false;
+      for (e = list_begin (&c->queue); e != list_end (&c->queue);
+           e = list_next (e))
+        {
+          struct disk_request *r = list_entry (e, struct disk_request, elem);
+
+          if (r->disk == first->disk && r->write == first->write
+              && r->done == 0 && r->sec_no == next_sector (first) + total
+              && total + r->cnt <= MAX_SECTORS_PER_CMD)
+            {
+              list_remove (&r->elem);
+              r->xfer = r->cnt;
+              list_push_back (batch, &r->batch_elem);
+              total += r->cnt;
+              merged = true;
+              break;
+            }
+        }
+    }
+  return total;
+}
+
+/* Body of the I/O thread for channel C_, which serves the
+   channel's request queue one batch at a time. */
+static void
+channel_thread (void *c_) 
+{
+  struct channel *c = c_;
+
+  for (;;) 
+    {
+      struct disk_request *first;
+      struct list batch;
+      struct list_elem *e;
+      disk_sector_t sec_no;
+      size_t cnt;
+      uint64_t t1, t2;
+
+      lock_acquire (&c->queue_lock);
+      while (list_empty (&c->queue))
+        cond_wait (&c->queue_nonempty, &c->queue_lock);
+      list_init (&batch);
+      cnt = take_batch (c, &batch);
+      lock_release (&c->queue_lock);
+
+      first = list_entry (list_front (&batch), struct disk_request,
+                          batch_elem);
+      sec_no = next_sector (first);
+
+      lock_acquire (&c->lock);
+      t1 = rdtsc ();
+      if (!dma_transfer (first->disk, sec_no, &batch, cnt, first->write))
+        pio_transfer (first->disk, sec_no, &batch, cnt, first->write);
+      first->disk->head = sec_no + cnt;
+      lock_release (&c->lock);
+      t2 = rdtsc ();
+
+      lock_acquire (&c->queue_lock);
+      account_command (first->disk, t2 - t1);
+      for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+        {
+          struct disk_request *r = list_entry (e, struct disk_request,
+                                               batch_elem);
+          if (r->done == 0)
+            r->start_tsc = t1;
+          r->done += r->xfer;
+          if (r->done == r->cnt)
+            account_request (r, t2);
+        }
+      lock_release (&c->queue_lock);
+
+      /* Finished requests have been removed from the queue by
+         take_batch(), so COMPLETE may free them. */
+      while (!list_empty (&batch)) 
+        {
+          struct disk_request *r = list_entry (list_pop_front (&batch),
+                                               struct disk_request,
+                                               batch_elem);
+          if (r->done == r->cnt)
+            r->complete (r);
+        }
+    }
+}
+
+/* Statistics. */
+
+/* Returns the CPU's cycle counter. */
+static inline uint64_t
+rdtsc (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Records a command on disk D that took LATENCY cycles from issue
+   to completion.
+   The caller must hold D's channel's queue lock. */
+static void
+account_command (struct disk *d, uint64_t latency) 
+{
+  int bucket = 0;
+
+  while (bucket < DISK_LATENCY_BUCKETS - 1 && (latency >> (bucket + 1)) != 0)
+    bucket++;
+  d->stats.latency[bucket]++;
+  d->stats.commands++;
+}
+
+/* Records the completion of request R at cycle END.
+   The caller must hold R's disk's channel's queue lock. */
+static void
+account_request (struct disk_request *r, uint64_t end) 
+{
+  struct disk_stat *st = &r->disk->stats;
+  struct disk_class_stat *cs = &st->class[r->class];
+
+  if (r->write)
+    st->write_cnt += r->cnt;
+  else
+    st->read_cnt += r->cnt;
+  cs->requests++;
+  cs->sectors += r->cnt;
+  cs->wait_cycles += r->start_tsc - r->submit_tsc;
+  cs->service_cycles += end - r->start_tsc;
+}
+
+/* PIO and DMA transfers of a batch of requests.  The caller must
+   hold the disk's channel lock. */
+
+/* Position within the buffers of a batch of requests. */
+struct batch_pos
+  {
+    struct list_elem *e;        /* Current request. */
+    size_t i;                   /* Sector within its XFER sectors. */
+  };
+
+/* Returns the buffer for the next sector of the batch at *P and
+   advances *P. */
+static uint8_t *
+batch_next (struct batch_pos *p) 
+{
+  struct disk_request *r = list_entry (p->e, struct disk_request,
+                                       batch_elem);
+  uint8_t *buffer = (uint8_t *) r->buffer + (r->done + p->i) * DISK_SECTOR_SIZE;
+
+  if (++p->i == r->xfer)
+    {
+      p->e = list_next (p->e);
+      p->i = 0;
+    }
+  return buffer;
+}
+
+/* Transfers the CNT sectors (at most MAX_SECTORS_PER_CMD) of BATCH,
+   starting at SEC_NO, between disk D and the requests' buffers by
+   PIO.  Uses READ/WRITE MULTIPLE (one interrupt per block of
+   sectors) if the disk supports it. */
+static void
+pio_transfer (struct disk *d, disk_sector_t sec_no, struct list *batch,
+              size_t cnt, bool write)
+{
+  struct channel *c = d->channel;
+  size_t block = cnt > 1 && d->multiple > 1 ? d->multiple : 1;
+  struct batch_pos p;
+  size_t i, j;
+
+  p.e = list_begin (batch);
+  p.i = 0;
+
+  select_sectors (d, sec_no, cnt);
+  if (write)
+    issue_pio_command (c, block > 1 ? CMD_WRITE_MULTIPLE
+                                    : CMD_WRITE_SECTOR_RETRY);
+  else
+    issue_pio_command (c, block > 1 ? CMD_READ_MULTIPLE
+                                    : CMD_READ_SECTOR_RETRY);
+
+  /* For reads the device interrupts once for each block it has
+     ready; for writes it asks for each block in turn (DRQ) and
+     interrupts once it has taken it.  The last block may be
+     short. */
+  for (i = 0; i < cnt; i += block)
+    {
+      size_t k = cnt - i < block ? cnt - i : block;
+
+      if (!write)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+               d->name, write ? "write" : "read", sec_no + i);
+      for (j = 0; j < k; j++)
+        if (write)
+          output_sectors (c, batch_next (&p), 1);
+        else
+          input_sectors (c, batch_next (&p), 1);
+      if (write)
+        sema_down (&c->completion_wait);
+    }
+}
+
+/* Transfers the CNT sectors (at most MAX_SECTORS_PER_CMD) of BATCH,
+   starting at SEC_NO, between disk D and the requests' buffers by
+   bus-master DMA, one PRD per buffer.  The CPU is free to run
+   other threads until the completion interrupt.
+   Returns false, having transferred nothing, if DMA is not
+   available for D or for some buffer (which must be word-aligned
+   kernel memory), or if the transfer failed; the caller should
+   then fall back to PIO. */
+static bool
+dma_transfer (struct disk *d, disk_sector_t sec_no, struct list *batch,
+              size_t cnt, bool write) 
+{
+  struct channel *c = d->channel;
+  size_t prd_cnt = 0;
+  uint8_t bm_status, status;
+  struct list_elem *e;
+
+  if (!d->dma)
+    return false;
+
+  /* Describe each buffer, which is physically contiguous because
+     all of physical memory is mapped linearly at PHYS_BASE,
+     splitting it at 64 kB boundaries. */
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct disk_request *r = list_entry (e, struct disk_request,
+                                           batch_elem);
+      uint8_t *buffer = (uint8_t *) r->buffer + r->done * DISK_SECTOR_SIZE;
+      uintptr_t phys, end;
+
+      if (!is_kernel_vaddr (buffer) || (uintptr_t) buffer % 2 != 0)
+        return false;
+      phys = vtop (buffer);
+      end = phys + r->xfer * DISK_SECTOR_SIZE;
+      while (phys < end)
+        {
+          uintptr_t boundary = (phys & ~0xffffu) + 0x10000;
+          uintptr_t limit = end < boundary ? end : boundary;
+
+          if (prd_cnt >= PRD_MAX)
+            return false;
+          c->prdt[prd_cnt].addr = phys;
+          c->prdt[prd_cnt].size = (limit - phys) & 0xffff;
+          c->prdt[prd_cnt].flags = 0;
+          prd_cnt++;
+          phys = limit;
+        }
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the bus master, then the disk, then start. */
+  outl (c->bm_base + BM_PRDT, vtop (c->prdt));
+  outb (c->bm_base + BM_COMMAND, write ? 0 : BMC_READ);
+  outb (c->bm_base + BM_STATUS, BMS_ERROR | BMS_INTR);
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (c->bm_base + BM_COMMAND, (write ? 0 : BMC_READ) | BMC_START);
+
+  sema_down (&c->completion_wait);
+
+  outb (c->bm_base + BM_COMMAND, write ? 0 : BMC_READ);
+  bm_status = inb (c->bm_base + BM_STATUS);
+  outb (c->bm_base + BM_STATUS, BMS_ERROR | BMS_INTR);
+  status = inb (reg_alt_status (c));
+  if ((bm_status & BMS_ERROR) || (status & STA_ERR))
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->dma = false;
+      return false;
+    }
+  return true;
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus
+   mastering (such as the PIIX emulated by QEMU and Bochs), enables
+   bus mastering on it, and returns its bus-master base port.
+   Returns 0 if there is none. */
+static uint16_t
+find_bus_master (void) 
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t addr = 0x80000000 | (dev << 11) | (func << 8);
+        uint32_t class, bar4, cmd;
+
+        outl (PCI_CONFIG_ADDR, addr);
+        if ((inl (PCI_CONFIG_DATA) & 0xffff) == 0xffff)
+          continue;
+
+        /* Class 01h (mass storage), subclass 01h (IDE), with
+           programming interface bit 7 (bus master capable). */
+        outl (PCI_CONFIG_ADDR, addr | 0x08);
+        class = inl (PCI_CONFIG_DATA);
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+
+        /* BAR4 holds the bus-master I/O ports. */
+        outl (PCI_CONFIG_ADDR, addr | 0x20);
+        bar4 = inl (PCI_CONFIG_DATA);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space and bus mastering. */
+        outl (PCI_CONFIG_ADDR, addr | 0x04);
+        cmd = inl (PCI_CONFIG_DATA);
+        outl (PCI_CONFIG_ADDR, addr | 0x04);
+        outl (PCI_CONFIG_DATA, (cmd & 0xffff) | 0x05);
+
+        printf ("ide: bus-master DMA at port %#x\n", bar4 & 0xfffc);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -383,11 +1097,19 @@ identify_ata_device (struct disk *d)
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
   /* Calculate capacity. */
   d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+  /* Word 47 gives the largest block READ/WRITE MULTIPLE can
+     transfer per interrupt, or 0 if those commands are not
+     supported. */
+  set_multiple_mode (d, id[47] & 0xff);
+
+  /* Word 49 bit 8 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (id[49] & 0x100) != 0;
+
   /* Print identification message. */
   printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
   if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -406,6 +1128,31 @@ identify_ata_device (struct disk *d)
   printf ("\"\n");
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D with the largest power
+   of 2 sectors per block that is at most MAX and MAX_MULTIPLE.
+   Leaves D's multiple member 0 if MAX is 0 or the disk rejects
+   the command. */
+static void
+set_multiple_mode (struct disk *d, int max) 
+{
+  struct channel *c = d->channel;
+  int cnt;
+
+  d->multiple = 0;
+  for (cnt = MAX_MULTIPLE; cnt > max; cnt /= 2)
+    continue;
+  if (cnt < 2)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = cnt;
+}
+
 /* Prints STRING, which consists of SIZE bytes in a funky format:
    each pair of bytes is in reverse order.  Does not print
    trailing whitespace and/or nulls. */
@@ -428,18 +1175,19 @@ print_ata_string (char *string, size_t size)
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+select_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < d->capacity);
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
+  ASSERT (sec_no + cnt <= d->capacity);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -460,20 +1208,21 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for DISK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *sectors, size_t cnt) 
 {
-  insw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
+  insw (reg_data (c), sectors, cnt * DISK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain DISK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors from SECTORS to channel C's data register in
+   PIO mode.  SECTORS must contain CNT * DISK_SECTOR_SIZE bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *sectors, size_t cnt) 
 {
-  outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), sectors, cnt * DISK_SECTOR_SIZE / 2);
 }
 
 /* Low-level ATA primitives. */
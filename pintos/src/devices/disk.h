@@ -1,7 +1,11 @@
 #ifndef DEVICES_DISK_H
 #define DEVICES_DISK_H
 
+#include <disk-stat.h>
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Size of a disk sector in bytes. */
@@ -15,12 +19,41 @@ typedef uint32_t disk_sector_t;
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* An asynchronous disk request, for disk_submit(). */
+struct disk_request
+  {
+    struct disk *disk;          /* Disk to access. */
+    disk_sector_t sec_no;       /* First sector. */
+    void *buffer;               /* CNT * DISK_SECTOR_SIZE bytes. */
+    size_t cnt;                 /* Number of sectors. */
+    bool write;                 /* True to write, false to read. */
+    enum disk_io_class class;   /* Who the request is for. */
+    void (*complete) (struct disk_request *);   /* Called when done. */
+    void *aux;                  /* For COMPLETE's use. */
+
+    /* Owned by the driver. */
+    size_t done;                /* Sectors transferred so far. */
+    size_t xfer;                /* Sectors in the current command. */
+    struct list_elem elem;      /* Channel queue element. */
+    struct list_elem batch_elem;        /* Element in a merged command. */
+    uint64_t submit_tsc;        /* Cycle counter at disk_submit(). */
+    uint64_t start_tsc;         /* Cycle counter when service began. */
+  };
+
 void disk_init (void);
+void disk_enable_dma (void);
+void disk_use_ram (int chan_no, int dev_no, size_t kb);
 void disk_print_stats (void);
+void disk_get_stats (struct disk *, struct disk_stat *);
 
 struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multiple (struct disk *, disk_sector_t, void *, size_t,
+                         enum disk_io_class);
+void disk_write_multiple (struct disk *, disk_sector_t, const void *, size_t,
+                          enum disk_io_class);
+void disk_submit (struct disk_request *);
 
 #endif /* devices/disk.h */
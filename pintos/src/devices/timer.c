@@ -205,8 +205,10 @@ timer_interrupt (struct intr_frame *args UNUSED)
 {
   ticks++;
 	check_unblockable();  /* unblock 될수있는 스레드가 있는지 검사 */
-/*	if (is_init_bfc)
-	  check_buffer_cache();*/
+#ifdef FILESYS
+	if (is_init_bfc)
+	  buffer_cache_tick();  /* 주기마다 buffer cache flusher를 깨운다 */
+#endif
 	thread_tick ();
 }
 
@@ -1,52 +1,678 @@
 #include "filesys/buf_cache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "devices/disk.h"
 #include "filesys/inode.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
 #include "lib/string.h"
 #include <string.h>
 #include <stdio.h>
 #include <round.h>
+#include <stdlib.h>
 
-static struct list buffer_cache;
+/* buffer cache의 데이터는 palloc으로 받은 page 단위로 잡는다.
+   page 하나가 BFC_PAGE_SECTORS개의 entry를 담는다. */
+struct bfc_page
+{
+	void *kpage;                                 /* palloc으로 받은 page */
+	struct bfc_entry slots[BFC_PAGE_SECTORS];    /* 이 page의 entry들 */
+	struct list_elem elem;
+};
+
+static struct list buffer_cache;  /* sector를 담고 있는 entry들 (clock 순서) */
+static struct list free_entries;  /* 아직 아무 sector도 담지 않은 entry들 */
+static struct list bfc_pages;     /* 캐시에 할당된 page들 */
+static struct hash buffer_index; /* sector -> entry 로 찾기 위한 hash */
+/* buffer_index를 바꿀 때는 bfc_lock과 index_lock(exclusive)을 모두 잡는다.
+   그래서 bfc_lock을 잡은 쪽은 그대로 찾으면 되고, 찾기만 하는 쪽은
+   index_lock을 shared로 잡아서 bfc_lock을 기다리지 않는다. */
+static struct rwlock index_lock;
 static uint32_t entries;  /* buffer_cache의 entry수 */
+static uint32_t capacity;   /* 할당된 page들이 담을 수 있는 entry 수 */
+static uint32_t cache_size = BUF_CACHE_SIZE;  /* 목표 캐시 크기 (sector 수) */
 struct lock bfc_lock;
+static struct condition bfc_unpinned;  /* 어떤 entry의 pin이 모두 풀림 */
+
+static struct bfc_entry *get_pinned (disk_sector_t, bool, bool,
+                                     enum disk_io_class);
+static void put_pinned (struct bfc_entry *);
+static void read_sector (disk_sector_t, void *, int, int,
+                         enum disk_io_class);
+static void write_sector (disk_sector_t, const void *, int, int,
+                          enum disk_io_class);
+static struct bfc_entry *alloc_entry (void);
+static void unpin (struct bfc_entry *);
+static bool write_behind_sector (disk_sector_t);
+static bool grow_cache (void);
+static bool release_page (struct bfc_page *);
+
+/* write-behind를 담당하는 flusher 스레드 관련 변수들 */
+static int64_t bfc_tick;              /* 마지막 flush 이후 지난 tick */
+static int64_t flush_interval = BFC_FLUSH_INTERVAL; /* flush 주기 (tick) */
+static uint32_t dirty_cnt;            /* dirty인 entry의 수 */
+static bool flush_wanted;             /* flusher를 이미 깨웠는지 */
+static struct semaphore flush_sema;   /* flusher를 깨우기 위한 세마포 */
+static struct lock flush_lock;        /* flush pass를 한번에 하나씩만 */
+static void *cluster_buf;             /* 인접한 sector들을 한번에 쓰기 위한 버퍼 */
+static size_t cluster_max;            /* cluster_buf에 들어가는 sector 수 */
 
-int64_t bfc_tick;
+/* metadata journal (filesys/journal.c). metadata sector에 쓰면 entry를
+   journaled로 표시하고, journal에 commit될 때까지는 제자리(home)에
+   쓰지도, 쫓아내지도 않는다. */
+static size_t journal_max;            /* 0이면 journal을 쓰지 않음 */
+static size_t journaled_cnt;          /* journaled인 entry의 수 */
+static void journal_entry (struct bfc_entry *);
+static size_t journal_limit (void);
 
-//victim을 고르는 함수 - clock algorithm 사용
+static void flusher_daemon (void *);
+static void flush_dirty (void);
+static size_t write_cluster (struct bfc_entry **, size_t);
+static void set_dirty (struct bfc_entry *, bool);
+
+/* 교체 정책. 부팅할 때 -bfc-policy로 고른다. */
+static enum bfc_policy policy = BFC_POLICY_CLOCK;
+static const char *policy_names[BFC_POLICY_CNT] = { "clock", "2q" };
+static uint64_t policy_hits[BFC_POLICY_CNT];    /* 정책별 캐시 hit 수 */
+static uint64_t policy_misses[BFC_POLICY_CNT];  /* 정책별 캐시 miss 수 */
+
+/* 캐시 통계. write_backs는 interrupt를 끄고, 나머지는 bfc_lock을 잡고
+   갱신한다. */
+static struct cache_stat stats;
+static size_t lookup_length (disk_sector_t);
+
+/* 캐시를 거치지 않고 disk에 쓰고 있는 sector들. 쓰기가 끝나기 전에 같은
+   sector를 캐시로 읽어오면 옛 내용이 캐시에 남으므로, miss가 나면
+   이 목록을 확인하고 기다린다. */
+struct direct_write
+{
+	disk_sector_t sector;   /* 첫 sector */
+	size_t cnt;             /* sector 수 */
+	struct list_elem elem;
+};
+static struct list direct_writes;
+static struct condition direct_done;  /* direct write가 하나 끝남 */
+static bool direct_write_pending (disk_sector_t);
+
+//victim을 고르는 함수 - policy에 따라 clock_victim 또는 twoq_victim
 static struct bfc_entry * select_victim (void);
+static bool can_evict (struct bfc_entry *);
+static void policy_insert (struct bfc_entry *);
+static void policy_hit (struct bfc_entry *);
+static void policy_remove (struct bfc_entry *, bool);
+
+/* clock */
+static struct bfc_entry * clock_victim (void);
 static struct list_elem *cur_victim; //선정된 victim을 가리킴
 
+/* 2Q (Johnson & Shasha). 한 번만 접근된 sector는 A1in(FIFO)에 들어가고,
+   A1in에서 밀려난 sector 번호는 A1out(ghost)에 기억해둔다. A1out에
+   남아있는 동안 다시 접근된 sector만 Am(LRU)으로 들어가므로, 한 번 쭉
+   읽고 마는 큰 파일이 Am에 있는 directory/inode sector를 밀어내지 못한다. */
+struct bfc_ghost
+{
+	disk_sector_t sector;
+	struct hash_elem hash_elem;
+	struct list_elem elem;
+};
+
+static struct list q_a1in;        /* 한 번 접근된 entry들 (앞쪽이 최근) */
+static struct list q_am;          /* 두 번 이상 접근된 entry들 (앞쪽이 최근) */
+static uint32_t a1in_cnt;         /* q_a1in의 길이 */
+static struct list q_a1out;       /* A1in에서 쫓겨난 sector들 (앞쪽이 최근) */
+static struct hash a1out_index;   /* sector -> ghost */
+static uint32_t a1out_cnt;        /* q_a1out의 길이 */
+
+static struct bfc_entry * twoq_victim (void);
+static void ghost_add (disk_sector_t);
+static bool ghost_take (disk_sector_t);
+static void ghost_free (struct hash_elem *, void *);
+static unsigned ghost_hash (const struct hash_elem *, void *);
+static bool ghost_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+
+/* read-ahead 요청. read_ahead_daemon이 큐에서 하나씩 꺼내 처리한다. */
+struct ra_request
+{
+	disk_sector_t sector;
+	enum disk_io_class io_class;
+	struct list_elem elem;
+};
+
+static struct list ra_queue;          /* 처리를 기다리는 read-ahead 요청들 */
+static size_t ra_queued;              /* ra_queue의 길이 */
+static disk_sector_t ra_in_flight;    /* daemon이 지금 읽고 있는 sector */
+static struct lock ra_lock;           /* ra_queue, ra_in_flight를 위한 lock */
+static struct semaphore ra_sema;      /* ra_queue에 들어있는 요청의 수 */
+
+static void read_ahead_daemon (void *);
+static bool ra_pending (disk_sector_t);
+
+static struct bfc_entry *look_up_locked (disk_sector_t);
+static unsigned bfc_hash (const struct hash_elem *, void *);
+static bool bfc_less (const struct hash_elem *, const struct hash_elem *,
+                      void *);
+
 void init_buffer_cache(void)
 {
 	list_init(&buffer_cache);
+	list_init(&free_entries);
+	list_init(&bfc_pages);
+	capacity = 0;
+	if (!hash_init(&buffer_index, bfc_hash, bfc_less, NULL))
+		PANIC ("buffer cache index creation failed");
 	lock_init(&bfc_lock);
+	rwlock_init(&index_lock);
+	cond_init(&bfc_unpinned);
+	list_init(&direct_writes);
+	cond_init(&direct_done);
   entries = 0;
   cur_victim = NULL;
+	list_init(&q_a1in);
+	list_init(&q_am);
+	list_init(&q_a1out);
+	a1in_cnt = a1out_cnt = 0;
+	if (!hash_init(&a1out_index, ghost_hash, ghost_less, NULL))
+		PANIC ("buffer cache ghost index creation failed");
 	bfc_tick = 0;
+	dirty_cnt = 0;
+	flush_wanted = false;
+	sema_init(&flush_sema, 0);
+	lock_init(&flush_lock);
+
+	/* 큰 버퍼를 못 받으면 page 하나로라도 clustering을 한다. */
+	cluster_max = BFC_CLUSTER_PAGES * BFC_PAGE_SECTORS;
+	cluster_buf = palloc_get_multiple(0, BFC_CLUSTER_PAGES);
+	if (cluster_buf == NULL) {
+		cluster_max = BFC_PAGE_SECTORS;
+		cluster_buf = palloc_get_page(0);
+	}
+
+	list_init(&ra_queue);
+	ra_queued = 0;
+	ra_in_flight = (disk_sector_t) -1;
+	lock_init(&ra_lock);
+	sema_init(&ra_sema, 0);
+	if (thread_create("read_ahead", PRI_DEFAULT, read_ahead_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("can't create read-ahead thread");
+	if (thread_create("bfc_flusher", PRI_DEFAULT, flusher_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("can't create buffer cache flusher thread");
 }
 
-void check_buffer_cache(void)
+/* 캐시 통계를 *ST에 복사한다. */
+void buffer_cache_get_stats (struct cache_stat *st)
 {
 	enum intr_level old_level;
+
+	lock_acquire(&bfc_lock);
 	old_level = intr_disable();
+	*st = stats;
+	intr_set_level(old_level);
+	st->size = capacity;
+	st->policy = policy;
+	lock_release(&bfc_lock);
+}
+
+/* 캐시 통계를 출력한다. */
+void buffer_cache_print_stats (void)
+{
+	struct cache_stat st;
+	uint64_t total;
+	int i;
+
+	buffer_cache_get_stats(&st);
+	total = st.hits + st.misses;
+	printf ("Buffer cache: %llu hits, %llu misses (%llu%% hit rate), "
+					"%llu evictions, %llu write-backs\n",
+					st.hits, st.misses, total > 0 ? st.hits * 100 / total : 0,
+					st.evictions, st.write_backs);
+	printf ("Buffer cache: %llu read-ahead, %llu used; "
+					"lookup length %llu.%02llu\n",
+					st.ra_issued, st.ra_used,
+					st.lookups > 0 ? st.lookup_steps / st.lookups : 0,
+					st.lookups > 0 ? st.lookup_steps * 100 / st.lookups % 100 : 0);
+	for (i = 0; i < BFC_POLICY_CNT; i++) {
+		total = policy_hits[i] + policy_misses[i];
+		if (i != (int) policy && total == 0)
+			continue;
+		printf ("Buffer cache (%s): %llu hits, %llu misses, %llu%% hit rate\n",
+						policy_names[i], policy_hits[i], policy_misses[i],
+						total > 0 ? policy_hits[i] * 100 / total : 0);
+	}
+}
+
+/* 교체 정책을 NAME("clock" 또는 "2q")으로 정한다. (커널 옵션 -bfc-policy)
+   init_buffer_cache() 전에 불러야 한다. 모르는 이름이면 false를 리턴. */
+bool buffer_cache_set_policy (const char *name)
+{
+	int i;
+
+	for (i = 0; i < BFC_POLICY_CNT; i++)
+		if (!strcmp(name, policy_names[i])) {
+			policy = i;
+			return true;
+		}
+	return false;
+}
+
+/* 캐시 크기를 KB 킬로바이트로 정한다. (커널 옵션 -bfc-size)
+   init_buffer_cache() 전에 불러도 된다. */
+void buffer_cache_set_size (size_t kb)
+{
+	cache_size = ROUND_UP(kb * 1024 / DISK_SECTOR_SIZE, BFC_PAGE_SECTORS);
+	if (cache_size == 0)
+		cache_size = BFC_PAGE_SECTORS;
+}
+
+/* 실행 중에 캐시 크기를 SECTORS개의 sector로 바꾼다. (cache_resize
+   system call) 늘릴 때는 page가 필요해질 때 하나씩 할당되고, 줄일 때는
+   먼저 journal을 commit해서 dirty entry를 모두 write-behind한 뒤 pin된
+   entry나 dirty entry가 없는 page부터 palloc에 돌려준다. 그런 page가 있으면
+   그만큼 덜 줄어들 수 있다. journaled entry가 캐시의 절반까지 차지할 수
+   있으므로 BFC_MIN_SIZE보다 작게는 줄이지 않는다. 파일 시스템 lock이나
+   journal operation 없이 호출해야 한다.
+   실제로 할당되어 있는 entry의 수를 리턴한다. */
+size_t buffer_cache_resize (size_t sectors)
+{
+	struct list_elem *e, *prev;
+	size_t ret;
+
+	if (sectors < BFC_MIN_SIZE)
+		sectors = BFC_MIN_SIZE;
+	lock_acquire(&bfc_lock);
+	cache_size = ROUND_UP(sectors, BFC_PAGE_SECTORS);
+	lock_release(&bfc_lock);
+
+	// disk write는 bfc_lock 없이 미리 해두어서 그 동안 캐시가 멈추지 않게 한다.
+	// journaled entry는 commit해야 제자리에 쓰고 돌려줄 수 있다.
+	journal_commit();
+
+	lock_acquire(&flush_lock);
+	lock_acquire(&bfc_lock);
+
+	// 최근에 추가된 page부터 돌려준다.
+	for (e = list_rbegin(&bfc_pages);
+			 capacity > cache_size && e != list_rend(&bfc_pages); e = prev) {
+		prev = list_prev(e);
+		release_page(list_entry(e, struct bfc_page, elem));
+	}
+	ret = capacity;
+
+	lock_release(&bfc_lock);
+	lock_release(&flush_lock);
+
+	return ret;
+}
+
+/* page를 하나 더 할당해서 free_entries에 BFC_PAGE_SECTORS개의 entry를
+   추가한다. bfc_lock을 잡은 상태에서 호출 */
+static bool grow_cache (void)
+{
+	struct bfc_page *pg;
+	int i;
+
+	pg = malloc(sizeof *pg);
+	if (pg == NULL)
+		return false;
+	pg->kpage = palloc_get_page(0);
+	if (pg->kpage == NULL) {
+		free(pg);
+		return false;
+	}
+
+	for (i = 0; i < BFC_PAGE_SECTORS; i++) {
+		struct bfc_entry *bfce = &pg->slots[i];
+
+		bfce->addr = (uint8_t *) pg->kpage + i * DISK_SECTOR_SIZE;
+		bfce->in_use = false;
+		bfce->evictable = true;
+		bfce->num_of_accessor = 0;
+		bfce->state = BFC_VALID;
+		bfce->dirty = false;
+		bfce->writing = false;
+		bfce->accessed = false;
+		bfce->prefetched = false;
+		lock_init(&bfce->lock);
+		cond_init(&bfce->io_done);
+		list_push_back(&free_entries, &bfce->elem);
+	}
+	list_push_back(&bfc_pages, &pg->elem);
+	capacity += BFC_PAGE_SECTORS;
+
+	return true;
+}
+
+/* page의 entry들을 캐시에서 빼고 page를 돌려준다. pin되었거나 dirty인
+   entry가 있으면 아무것도 하지 않고 false를 리턴. bfc_lock을 잡은 상태에서
+   호출하므로 여기서는 disk에 쓰지 않는다. */
+static bool release_page (struct bfc_page *pg)
+{
+	int i;
+
+	for (i = 0; i < BFC_PAGE_SECTORS; i++)
+		if (pg->slots[i].in_use && (pg->slots[i].num_of_accessor > 0
+																|| pg->slots[i].writing
+																|| pg->slots[i].dirty
+																|| pg->slots[i].journaled))
+			return false;
+
+	for (i = 0; i < BFC_PAGE_SECTORS; i++) {
+		struct bfc_entry *bfce = &pg->slots[i];
+
+		if (bfce->in_use) {
+			rwlock_acquire_exclusive(&index_lock);
+			hash_delete(&buffer_index, &bfce->hash_elem);
+			rwlock_release_exclusive(&index_lock);
+			policy_remove(bfce, false);
+			// clock 바늘이 빠지는 entry를 가리키고 있으면 다음으로 옮긴다.
+			if (cur_victim == &bfce->elem) {
+				cur_victim = list_next(cur_victim);
+				if (cur_victim == list_end(&buffer_cache))
+					cur_victim = NULL;
+			}
+			entries--;
+		}
+		list_remove(&bfce->elem);
+	}
+	list_remove(&pg->elem);
+	palloc_free_page(pg->kpage);
+	free(pg);
+	capacity -= BFC_PAGE_SECTORS;
+
+	return true;
+}
+
+/* flusher가 깨어나는 주기를 MS 밀리초로 바꾼다. (커널 옵션 -bfc-flush) */
+void buffer_cache_set_flush_interval (int ms)
+{
+	flush_interval = (int64_t) ms * TIMER_FREQ / 1000;
+	if (flush_interval < 1)
+		flush_interval = 1;
+}
 
-	bfc_tick++;
-	if (bfc_tick == BFC_TICK_FEQ) {
-		buffer_cache_write_behind_all();
+/* timer interrupt마다 호출된다. interrupt context이므로 lock을 잡거나
+   disk I/O를 할 수 없다. 주기가 되면 flusher 스레드를 깨우기만 한다. */
+void buffer_cache_tick (void)
+{
+	if (++bfc_tick >= flush_interval) {
 		bfc_tick = 0;
+		sema_up(&flush_sema);
 	}
+}
 
-	intr_set_level (old_level);
+/* 깨어날 때마다 dirty entry들을 sector 순서대로 disk에 쓰는 스레드.
+   eviction 때 write-back을 해야하는 경우를 줄여서 foreground 스레드가
+   disk write를 기다리지 않도록 한다. */
+static void flusher_daemon (void *aux UNUSED)
+{
+	for (;;) {
+		sema_down(&flush_sema);
+		flush_wanted = false;
+		// free map과 metadata를 journal에 commit하고 dirty entry를 내보낸다.
+		journal_commit();
+	}
 }
-  
-static struct bfc_entry *select_victim() 
+
+/* entry의 dirty bit을 바꾸고 dirty_cnt를 맞춰준다. dirty entry가
+   BFC_DIRTY_RATIO%를 넘으면 주기를 기다리지 않고 flusher를 깨운다. */
+static void set_dirty (struct bfc_entry *bfce, bool dirty)
+{
+	enum intr_level old_level;
+
+	old_level = intr_disable();
+	if (bfce->dirty != dirty) {
+		bfce->dirty = dirty;
+		if (dirty)
+			dirty_cnt++;
+		else {
+			dirty_cnt--;
+			stats.write_backs++;
+		}
+	}
+	if (dirty && !flush_wanted
+			&& dirty_cnt * 100 >= cache_size * BFC_DIRTY_RATIO) {
+		flush_wanted = true;
+		sema_up(&flush_sema);
+	}
+	intr_set_level(old_level);
+}
+
+/* qsort()를 위한 비교 함수 - sector 번호 오름차순 */
+static int cmp_sector (const void *a_, const void *b_)
+{
+	const struct bfc_entry *a = *(struct bfc_entry * const *) a_;
+	const struct bfc_entry *b = *(struct bfc_entry * const *) b_;
+
+	return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* sector 순으로 정렬된 dirty entry들 ENTS의 앞에서부터, sector 번호가
+   연속인 entry들을 cluster_buf에 모아서 disk_write_multiple() 한번으로
+   쓴다. 처리한 entry의 수를 리턴한다. flush_lock을 잡은 상태에서 호출 */
+static size_t write_cluster (struct bfc_entry **ents, size_t cnt)
+{
+	size_t n, i;
+
+	// disk 통계를 위해 종류(data/metadata)가 다른 entry는 같이 묶지 않는다.
+	for (n = 1; n < cnt && n < cluster_max; n++)
+		if (ents[n]->sector != ents[0]->sector + n
+				|| ents[n]->io_class != ents[0]->io_class)
+			break;
+
+	if (n == 1 || cluster_buf == NULL) {
+		buffer_cache_write_behind(ents[0]);
+		return 1;
+	}
+
+	// entry lock은 항상 sector 오름차순으로 잡으므로 deadlock이 없다.
+	// 모은 뒤에 다른 스레드가 먼저 썼거나 journal에 들어갔을 수 있으므로
+	// buffer_cache_write_behind()처럼 entry lock을 잡고 다시 확인하고,
+	// 조건이 안 맞는 entry에서 cluster를 끊는다.
+	for (i = 0; i < n; i++) {
+		lock_acquire(&ents[i]->lock);
+		if (!ents[i]->dirty || ents[i]->journaled) {
+			lock_release(&ents[i]->lock);
+			break;
+		}
+		ents[i]->writing = true;
+		memcpy((uint8_t *) cluster_buf + i * DISK_SECTOR_SIZE, ents[i]->addr,
+					 DISK_SECTOR_SIZE);
+	}
+	// 첫 entry부터 쓸 필요가 없으면 그 entry만 건너뛴다.
+	if (i == 0)
+		return 1;
+	n = i;
+	disk_write_multiple(filesys_disk, ents[0]->sector, cluster_buf, n,
+											ents[0]->io_class);
+	for (i = 0; i < n; i++) {
+		set_dirty(ents[i], false);
+		ents[i]->writing = false;
+		lock_release(&ents[i]->lock);
+	}
+
+#ifdef BFC_DEBUG
+	printf("Write-Behind cluster: sector=%u, count=%u\n", ents[0]->sector, n);
+#endif
+	return n;
+}
+
+/* 모든 dirty entry를 sector 순서대로 write-behind.
+   sector 번호가 연속인 entry들은 묶어서 한번의 disk write로 보낸다.
+   bfc_lock을 잡은 채로 dirty entry를 모아서 pin만 해두고, 실제 disk
+   write는 bfc_lock 없이 하므로 그 동안에도 다른 스레드가 캐시를 쓸 수 있다. */
+static void flush_dirty (void)
+{
+  struct list_elem *e;
+  struct bfc_entry *cur, **dirty;
+	size_t cnt = 0, i;
+
+	lock_acquire(&flush_lock);
+	lock_acquire(&bfc_lock);
+
+	dirty = malloc(entries * sizeof *dirty);
+	if (dirty == NULL) {
+		/* 메모리가 부족하면 예전처럼 리스트 순서대로 하나씩 쓴다. 쓰는 동안은
+		   pin으로 entry를 붙잡아두고 bfc_lock은 놓는다. */
+		for (e = list_begin(&buffer_cache) ; e != list_end(&buffer_cache) ; 
+				 e = list_next(e)) {
+			cur = list_entry(e, struct bfc_entry, elem);
+			if (!cur->dirty || cur->state != BFC_VALID || cur->journaled)
+				continue;
+			cur->num_of_accessor++;
+			lock_release(&bfc_lock);
+			buffer_cache_write_behind(cur);
+			lock_acquire(&bfc_lock);
+			unpin(cur);
+		}
+		lock_release(&bfc_lock);
+		lock_release(&flush_lock);
+		return;
+	}
+
+  for (e = list_begin(&buffer_cache) ; e != list_end(&buffer_cache) ; 
+			 e = list_next(e)) {
+    cur = list_entry(e, struct bfc_entry, elem);
+    if (cur->dirty && cur->state == BFC_VALID && !cur->journaled) {
+			cur->num_of_accessor++;
+			dirty[cnt++] = cur;
+		}
+  }
+	lock_release(&bfc_lock);
+
+	qsort(dirty, cnt, sizeof *dirty, cmp_sector);
+	for (i = 0; i < cnt; )
+		i += write_cluster(dirty + i, cnt - i);
+
+	lock_acquire(&bfc_lock);
+	for (i = 0; i < cnt; i++)
+		unpin(dirty[i]);
+	lock_release(&bfc_lock);
+	lock_release(&flush_lock);
+
+	free(dirty);
+#ifdef BFC_DEBUG
+	printf("FLUSH: count=%u\n", cnt);
+#endif
+}
+
+/* sector를 미리 읽어오도록 read_ahead_daemon에게 요청한다.
+   요청만 큐에 넣고 바로 리턴하므로 호출한 스레드는 disk I/O를 기다리지
+   않는다. 이미 캐시에 있거나 큐에 들어있는 sector는 다시 요청하지 않는다.
+   IO_CLASS는 disk 통계에서 이 읽기를 어느 쪽으로 셀지 정한다. */
+void buffer_cache_read_ahead (disk_sector_t sector_idx,
+                              enum disk_io_class io_class)
+{
+	struct ra_request *req;
+
+	if ((int)sector_idx == -1 || buffer_cache_look_up(sector_idx) != NULL)
+		return;
+
+	lock_acquire(&ra_lock);
+	if (ra_queued >= RA_QUEUE_MAX || ra_pending(sector_idx)) {
+		lock_release(&ra_lock);
+		return;
+	}
+	req = malloc(sizeof *req);
+	if (req == NULL) { // read-ahead는 힌트일 뿐이므로 실패해도 무시
+		lock_release(&ra_lock);
+		return;
+	}
+	req->sector = sector_idx;
+	req->io_class = io_class;
+	list_push_back(&ra_queue, &req->elem);
+	ra_queued++;
+	lock_release(&ra_lock);
+
+	sema_up(&ra_sema);
+#ifdef BFC_DEBUG
+	printf("READ-AHEAD queued: sector=%u\n", sector_idx);
+#endif
+}
+
+/* sector가 이미 큐에 있거나 daemon이 읽고 있는 중인지 검사.
+   ra_lock을 잡은 상태에서 호출 */
+static bool ra_pending (disk_sector_t sector_idx)
+{
+	struct list_elem *e;
+
+	if (ra_in_flight == sector_idx)
+		return true;
+	for (e = list_begin(&ra_queue); e != list_end(&ra_queue); e = list_next(e))
+		if (list_entry(e, struct ra_request, elem)->sector == sector_idx)
+			return true;
+	return false;
+}
+
+/* read-ahead 요청을 꺼내서 해당 sector를 buffer cache에 올리는 스레드 */
+static void read_ahead_daemon (void *aux UNUSED)
+{
+	struct ra_request *req;
+	struct bfc_entry *bfce;
+
+	for (;;) {
+		sema_down(&ra_sema);
+
+		lock_acquire(&ra_lock);
+		req = list_entry(list_pop_front(&ra_queue), struct ra_request, elem);
+		ra_queued--;
+		ra_in_flight = req->sector;
+		lock_release(&ra_lock);
+
+		bfce = get_pinned(req->sector, true, false, req->io_class);
+		lock_acquire(&bfc_lock);
+		unpin(bfce);
+		lock_release(&bfc_lock);
+
+		lock_acquire(&ra_lock);
+		ra_in_flight = (disk_sector_t) -1;
+		lock_release(&ra_lock);
+		free(req);
+	}
+}
+
+/* sector를 buffer_index에서 찾을 때 hash chain에서 살펴보게 되는
+   element의 수. (bfc_lock을 잡은 상태에서 호출) */
+static size_t lookup_length (disk_sector_t sector_idx)
+{
+	struct bfc_entry key;
+
+	key.sector = sector_idx;
+	return hash_find_length(&buffer_index, &key.hash_elem);
+}
+
+/* buffer_index의 hash 함수 - entry가 담고 있는 sector 번호로 hash */
+static unsigned bfc_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+	const struct bfc_entry *bfce = hash_entry(e, struct bfc_entry, hash_elem);
+	return hash_int(bfce->sector);
+}
+
+static bool bfc_less (const struct hash_elem *a, const struct hash_elem *b,
+                      void *aux UNUSED)
+{
+	const struct bfc_entry *ea = hash_entry(a, struct bfc_entry, hash_elem);
+	const struct bfc_entry *eb = hash_entry(b, struct bfc_entry, hash_elem);
+	return ea->sector < eb->sector;
+}
+
+/* clock algorithm으로 victim을 고른다. flusher가 dirty entry를 미리 써두므로
+   clean entry를 우선으로 고르고, 두 바퀴를 돌아도 없을 때만 dirty entry를
+   victim으로 삼는다. pin되어 있거나 I/O 중인 entry는 고르지 않으며,
+   네 바퀴를 돌아도 고를 수 있는 entry가 없으면 NULL을 리턴한다. */
+static struct bfc_entry *clock_victim (void)
 {
   struct bfc_entry *cur;
   bool cond;
+	uint32_t scanned = 0;
+
+	if (list_empty(&buffer_cache))
+		return NULL;
   
   while (true)
   {
@@ -56,9 +682,7 @@ static struct bfc_entry *select_victim()
           
     cur = list_entry (cur_victim, struct bfc_entry, elem);
         
-    //lock_acquire(&cur->lock);
-    cond = (cur->num_of_accessor == 0 &&  cur->evictable);
-    //lock_release (&cur->lock);
+    cond = (can_evict(cur) && (!cur->dirty || scanned >= 2 * entries));
       
     if (cond) {
 			// cur이 accessed라면 우선 false로 만들고 다른 entry를 찾아본다.
@@ -72,186 +696,623 @@ static struct bfc_entry *select_victim()
       cur_victim = list_begin(&buffer_cache);
     else
       cur_victim = list_next(cur_victim);
+		if (++scanned >= 4 * entries)
+			return NULL;
   }
       
   return cur;
 }
 
-/* entry가 새로 필요할 때 entry를 만들어준다.
-	 entry를 만들고 data 공간을 할당받고 disk I/O를 통해 data를 읽어온다.
-	 만약 buffer_cache가 꽉찼으면 victim을 write-behind-all하고 그 부분을 새 entry로 쓴다.*/
-/* 이 함수는 look_up()의 결과가 NULL일때 호출된다. */
-struct bfc_entry *buffer_cache_get_entry (struct inode *inode, off_t offset)
+/* pin되어 있지 않고 I/O 중도 아니어서 지금 victim으로 삼을 수 있는지 */
+static bool can_evict (struct bfc_entry *bfce)
+{
+	return bfce->num_of_accessor == 0 && bfce->evictable
+				 && bfce->state == BFC_VALID && !bfce->writing && !bfce->journaled;
+}
+
+static struct bfc_entry *select_victim (void)
+{
+	if (policy == BFC_POLICY_2Q)
+		return twoq_victim();
+	return clock_victim();
+}
+
+/* LIST의 뒤(오래된 쪽)부터 victim으로 삼을 수 있는 entry를 찾는다.
+   DIRTY가 false면 clean한 entry만 고른다. */
+static struct bfc_entry *scan_queue (struct list *list, bool dirty)
+{
+	struct list_elem *e;
+
+	for (e = list_rbegin(list); e != list_rend(list); e = list_prev(e)) {
+		struct bfc_entry *cur = list_entry(e, struct bfc_entry, q_elem);
+		if (can_evict(cur) && (dirty || !cur->dirty))
+			return cur;
+	}
+	return NULL;
+}
+
+/* 2Q의 victim 선정. A1in이 캐시의 BFC_2Q_KIN %보다 크면 A1in의 가장
+   오래된 entry를, 아니면 Am의 LRU entry를 고른다. clock과 마찬가지로
+   clean entry를 먼저 찾고, 양쪽 다 없을 때만 dirty entry를 고른다. */
+static struct bfc_entry *twoq_victim (void)
+{
+	struct list *first = &q_am, *second = &q_a1in;
+	struct bfc_entry *bfce;
+
+	if (a1in_cnt > cache_size * BFC_2Q_KIN / 100 || list_empty(&q_am)) {
+		first = &q_a1in;
+		second = &q_am;
+	}
+
+	if ((bfce = scan_queue(first, false)) != NULL
+			|| (bfce = scan_queue(second, false)) != NULL
+			|| (bfce = scan_queue(first, true)) != NULL)
+		return bfce;
+	return scan_queue(second, true);
+}
+
+/* 새로 sector를 담은 entry를 정책의 자료구조에 넣는다. (bfc_lock 필요) */
+static void policy_insert (struct bfc_entry *bfce)
+{
+	if (policy != BFC_POLICY_2Q)
+		return;
+	if (ghost_take(bfce->sector)) {
+		bfce->in_am = true;
+		list_push_front(&q_am, &bfce->q_elem);
+	}
+	else {
+		bfce->in_am = false;
+		list_push_front(&q_a1in, &bfce->q_elem);
+		a1in_cnt++;
+	}
+}
+
+/* 캐시 hit. (bfc_lock 필요) clock은 put_pinned()에서 accessed를
+   세우는 것으로 충분하다. 2Q는 Am에 있는 entry만 LRU 순서를 갱신하고
+   A1in에 있는 entry는 그대로 둔다. */
+static void policy_hit (struct bfc_entry *bfce)
+{
+	if (policy == BFC_POLICY_2Q && bfce->in_am) {
+		list_remove(&bfce->q_elem);
+		list_push_front(&q_am, &bfce->q_elem);
+	}
+}
+
+/* entry가 캐시에서 빠진다. EVICTED면 victim으로 쫓겨나는 것으로,
+   A1in에 있던 entry라면 sector 번호를 A1out에 남긴다. (bfc_lock 필요) */
+static void policy_remove (struct bfc_entry *bfce, bool evicted)
+{
+	if (policy != BFC_POLICY_2Q)
+		return;
+	list_remove(&bfce->q_elem);
+	if (!bfce->in_am) {
+		a1in_cnt--;
+		if (evicted)
+			ghost_add(bfce->sector);
+	}
+}
+
+/* A1out에 sector를 추가한다. 캐시의 BFC_2Q_KOUT %를 넘으면 가장
+   오래된 것부터 잊는다. */
+static void ghost_add (disk_sector_t sector_idx)
+{
+	struct bfc_ghost *g;
+
+	while (a1out_cnt > 0 && a1out_cnt >= cache_size * BFC_2Q_KOUT / 100) {
+		g = list_entry(list_pop_back(&q_a1out), struct bfc_ghost, elem);
+		hash_delete(&a1out_index, &g->hash_elem);
+		a1out_cnt--;
+		free(g);
+	}
+
+	g = malloc(sizeof *g);
+	if (g == NULL)
+		return;
+	g->sector = sector_idx;
+	if (hash_insert(&a1out_index, &g->hash_elem) != NULL) {
+		free(g);
+		return;
+	}
+	list_push_front(&q_a1out, &g->elem);
+	a1out_cnt++;
+}
+
+/* sector가 A1out에 있으면 빼고 true를 리턴 */
+static bool ghost_take (disk_sector_t sector_idx)
+{
+	struct bfc_ghost key, *g;
+	struct hash_elem *e;
+
+	key.sector = sector_idx;
+	e = hash_delete(&a1out_index, &key.hash_elem);
+	if (e == NULL)
+		return false;
+	g = hash_entry(e, struct bfc_ghost, hash_elem);
+	list_remove(&g->elem);
+	a1out_cnt--;
+	free(g);
+	return true;
+}
+
+static void ghost_free (struct hash_elem *e, void *aux UNUSED)
+{
+	free(hash_entry(e, struct bfc_ghost, hash_elem));
+}
+
+static unsigned ghost_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+	return hash_int(hash_entry(e, struct bfc_ghost, hash_elem)->sector);
+}
+
+static bool ghost_less (const struct hash_elem *a, const struct hash_elem *b,
+                        void *aux UNUSED)
+{
+	return hash_entry(a, struct bfc_ghost, hash_elem)->sector
+				 < hash_entry(b, struct bfc_ghost, hash_elem)->sector;
+}
+
+/* 새 sector를 담을 entry를 하나 마련해서 리턴한다. 리턴된 entry는 hash에
+   들어있지 않은 clean한 entry이다.
+   비어있는 entry가 있으면 그것을 쓰고, 없으면 victim을 고른다.
+   victim이 dirty면 bfc_lock을 잠시 놓고 write-behind를 한 뒤 NULL을
+   리턴하는데, 그 사이에 캐시 상태가 바뀌었을 수 있으므로 caller는
+   처음부터(look up부터) 다시 해야 한다. pin되지 않은 entry가 하나도
+   없을 때도 누군가 unpin할 때까지 기다린 뒤 NULL을 리턴한다.
+	 bfc_lock을 잡은 상태에서 호출해야 한다. */
+static struct bfc_entry *alloc_entry (void)
 {
-  //ASSERT (offset % DISK_SECTOR_SIZE == 0);
-    
   struct bfc_entry *bfce;
-  disk_sector_t sector_idx = byte_to_sector(inode, offset);
 
-	if ((int)sector_idx == -1)
-		return NULL;
+	ASSERT (lock_held_by_current_thread(&bfc_lock));
     
-  if (entries < BUF_CACHE_SIZE)
+	// 비어있는 entry가 없으면 목표 크기까지는 page를 새로 할당받는다.
+	if (list_empty(&free_entries) && capacity < cache_size)
+		grow_cache();
+
+  if (!list_empty(&free_entries))
   {
-    bfce = (struct bfc_entry *) malloc(sizeof(struct bfc_entry));
-    if (bfce == NULL) {
-      printf ("ERROR: fail to allocate memory for buffer cache entry\n");
-      return NULL;
-    }
-          
-    bfce->evictable = true;
+		bfce = list_entry(list_pop_front(&free_entries), struct bfc_entry, elem);
+		bfce->in_use = true;
     entries++;
     list_push_front (&buffer_cache, &bfce->elem);
-        
-		//실제 data를 저장할 공간 할당 (SECTOR 사이즈 만큼)
-    bfce->addr = malloc(DISK_SECTOR_SIZE);
-    if(bfce == NULL) {
-      printf ("ERROR: fail to allocate memory for buffer cache data\n");
-      free (bfce);
-      return NULL;
-    }
-          
-		// 그 섹터의 data를 disk에서 읽어옴
-    disk_read (filesys_disk, sector_idx, bfce->addr);
-   
-    bfce->inode = inode;
-    bfce->offset = offset;
-    bfce->dirty = false;
-    bfce->accessed = false;
-        
-    bfce->num_of_accessor = 0;
-    lock_init (&bfce->lock);
-
-#ifdef BFC_DEBUG
-		printf("DISK READ for making new bfc_entry: inode=%x, ofs=%d\n", 
-					  bfce->inode, bfce->offset);
-#endif
+		return bfce;
   }
-  else
-  { 
-		// buffer_cache가 꽉차있으므로 victim 선정
-    bfce = select_victim ();
+	if (entries == 0)
+		PANIC ("buffer cache: no memory for any entry");
+
+	// buffer_cache가 꽉차있으므로 victim 선정
+	bfce = select_victim ();
+	if (bfce == NULL) {
+		cond_wait(&bfc_unpinned, &bfc_lock);
+		return NULL;
+	}
        
-    // 선정된 entry가 dirty일 경우 disk에 write-behind
-    if (bfce->dirty)
-			buffer_cache_write_behind(bfce);
-        
-		lock_acquire(&bfce->lock);
-    disk_read (filesys_disk, sector_idx, bfce->addr);
-    bfce->inode = inode;
-    bfce->offset = offset;
-    bfce->num_of_accessor = 0;
-		bfce->dirty = false;
-		bfce->accessed = false;
-		lock_release(&bfce->lock);
-#ifdef BFC_DEBUG
-		printf("DISK READ for overwriting a victim bfc_entry: inode=%x, ofs=%d\n",
-				   bfce->inode, bfce->offset);
-#endif
-  }
-      
+	// 선정된 entry가 dirty일 경우 disk에 write-behind
+	if (bfce->dirty) {
+		bfce->num_of_accessor++;
+		lock_release(&bfc_lock);
+		buffer_cache_write_behind(bfce);
+		lock_acquire(&bfc_lock);
+		unpin(bfce);
+		return NULL;
+	}
+
+	// victim은 이제 다른 sector를 담게 되므로 hash에서 빼준다.
+	rwlock_acquire_exclusive(&index_lock);
+	hash_delete(&buffer_index, &bfce->hash_elem);
+	rwlock_release_exclusive(&index_lock);
+	policy_remove(bfce, true);
+	stats.evictions++;
   return bfce;
 }
 
-/* buffer_cache를 순회하며 inode, offset이 같은 entry를 찾아 리턴
-   만약 원하는 entry를 찾을 수 없으면 NULL 리턴*/
-struct bfc_entry *buffer_cache_look_up (struct inode *inode, off_t offset)
+/* sector를 담은 entry를 pin해서 돌려준다. (없으면 disk에서 읽어옴)
+   pin된 entry는 put_pinned()을 부를 때까지 victim으로 선정되지
+   않으므로, 그 동안 bfce->addr을 직접 읽고 쓸 수 있다.
+   READ가 false이면 캐시에 없더라도 disk를 읽지 않고 0으로 채운다.
+   (sector 전체를 덮어쓸 caller를 위한 것)
+
+   disk를 읽는 동안 entry는 BFC_LOADING 상태로 hash에 들어있고 bfc_lock은
+   놓여있다. 같은 sector를 찾는 다른 스레드는 disk I/O를 또 하지 않고
+   pin만 한 뒤 읽기가 끝날 때까지 io_done에서 기다린다.
+   DEMAND가 false면(read-ahead) hit/miss 통계와 교체 정책에 반영하지 않는다.
+   IO_CLASS는 이 sector가 file data인지 metadata인지로, disk 통계에 쓰인다. */
+static struct bfc_entry *get_pinned (disk_sector_t sector_idx, bool read,
+                                     bool demand, enum disk_io_class io_class)
 {
-  struct list_elem *e;
-  struct bfc_entry *cur;
-	disk_sector_t sector_idx;
- 
-	lock_acquire(&bfc_lock);
+  struct bfc_entry *bfce;
 
-  for (e = list_begin(&buffer_cache) ; e != list_end(&buffer_cache) ; 
-			 e = list_next(e)) {
-    cur = list_entry(e, struct bfc_entry, elem);
-    if (cur->inode == inode && cur->offset == offset) {
+	ASSERT ((int)sector_idx != -1);
+
+	lock_acquire(&bfc_lock);
+	if (demand) {
+		stats.lookups++;
+		stats.lookup_steps += lookup_length(sector_idx);
+	}
+	for (;;) {
+		bfce = look_up_locked(sector_idx);
+		if (bfce != NULL) {
+			bfce->num_of_accessor++;
+			if (demand) {
+				stats.hits++;
+				policy_hits[policy]++;
+				policy_hit(bfce);
+				if (bfce->prefetched) {
+					stats.ra_used++;
+					bfce->prefetched = false;
+				}
+			}
+			while (bfce->state == BFC_LOADING)
+				cond_wait(&bfce->io_done, &bfc_lock);
 			lock_release(&bfc_lock);
+			return bfce;
+		}
+
+		if (direct_write_pending(sector_idx)) {
+			cond_wait(&direct_done, &bfc_lock);
+			continue;
+		}
+
+		bfce = alloc_entry();
+		if (bfce != NULL)
+			break;
+	}
+
+  bfce->sector = sector_idx;
+	bfce->io_class = io_class;
+	bfce->journaled = false;
+  bfce->num_of_accessor = 1;
+	bfce->accessed = false;
+	if (read)
+		bfce->state = BFC_LOADING;
+	else {
+		memset (bfce->addr, 0, DISK_SECTOR_SIZE);
+		bfce->state = BFC_VALID;
+	}
+	rwlock_acquire_exclusive(&index_lock);
+	hash_insert(&buffer_index, &bfce->hash_elem);
+	rwlock_release_exclusive(&index_lock);
+	policy_insert(bfce);
+	bfce->prefetched = !demand;
+	if (demand) {
+		stats.misses++;
+		policy_misses[policy]++;
+	}
+	else
+		stats.ra_issued++;
+	lock_release(&bfc_lock);
+
+	if (read) {
+		// 그 섹터의 data를 disk에서 읽어옴 (bfc_lock 없이)
+  	disk_read_multiple (filesys_disk, sector_idx, bfce->addr, 1, io_class);
+
+		lock_acquire(&bfc_lock);
+		bfce->state = BFC_VALID;
+		cond_broadcast(&bfce->io_done, &bfc_lock);
+		lock_release(&bfc_lock);
+	}
+
 #ifdef BFC_DEBUG
-			printf("LOOK UP Success: inode=%x, ofs=%d\n", cur->inode, cur->offset);
+	printf("%s for bfc_entry: sector=%u\n", read ? "DISK READ" : "ZERO FILL",
+				 bfce->sector);
 #endif
-      return cur;
-    }
-  }
+	return bfce;
+}
+
+/* pin을 하나 푼다. pin이 모두 풀리면 victim을 찾지 못해 기다리고 있는
+   스레드를 깨운다. bfc_lock을 잡은 상태에서 호출 */
+static void unpin (struct bfc_entry *bfce)
+{
+	ASSERT (bfce->num_of_accessor > 0);
+	if (--bfce->num_of_accessor == 0)
+		cond_signal(&bfc_unpinned, &bfc_lock);
+}
+
+/* get_pinned()으로 pin한 entry를 놓아준다. */
+static void put_pinned (struct bfc_entry *bfce)
+{
+	lock_acquire(&bfc_lock);
+	bfce->accessed = true;
+	unpin(bfce);
+	lock_release(&bfc_lock);
+}
+
+/* sector의 SECTOR_OFS부터 SIZE 바이트를 BUFFER로 복사 (metadata) */
+void buffer_cache_read_sector (disk_sector_t sector_idx, void *buffer,
+															 int sector_ofs, int size)
+{
+	read_sector(sector_idx, buffer, sector_ofs, size, DISK_IO_META);
+}
+
+static void read_sector (disk_sector_t sector_idx, void *buffer,
+												 int sector_ofs, int size, enum disk_io_class io_class)
+{
+	struct bfc_entry *bfce;
+
+	ASSERT (sector_ofs >= 0 && sector_ofs + size <= DISK_SECTOR_SIZE);
+
+	bfce = get_pinned(sector_idx, true, true, io_class);
+	lock_acquire(&bfce->lock);
+	memcpy(buffer, (uint8_t *) bfce->addr + sector_ofs, size);
+	lock_release(&bfce->lock);
+	put_pinned(bfce);
+}
+
+/* BUFFER의 SIZE 바이트를 sector의 SECTOR_OFS 위치에 쓴다. (metadata)
+   disk에는 나중에 write-behind될 때 반영된다. */
+void buffer_cache_write_sector (disk_sector_t sector_idx, const void *buffer,
+																int sector_ofs, int size)
+{
+	write_sector(sector_idx, buffer, sector_ofs, size, DISK_IO_META);
+}
+
+static void write_sector (disk_sector_t sector_idx, const void *buffer,
+													int sector_ofs, int size, enum disk_io_class io_class)
+{
+	struct bfc_entry *bfce;
+
+	ASSERT (sector_ofs >= 0 && sector_ofs + size <= DISK_SECTOR_SIZE);
+
+	/* sector 전체를 덮어쓰는 경우에는 disk에서 미리 읽어올 필요가 없다. */
+	bfce = get_pinned(sector_idx, size != DISK_SECTOR_SIZE, true, io_class);
+	lock_acquire(&bfce->lock);
+	memcpy((uint8_t *) bfce->addr + sector_ofs, buffer, size);
+	set_dirty(bfce, true);
+	if (io_class == DISK_IO_META)
+		journal_entry(bfce);
+	lock_release(&bfce->lock);
+	put_pinned(bfce);
+}
+
+/* disk를 읽지 않고 sector를 0으로 채운다. (dirty로 표시됨)
+   새 파일의 data sector를 위한 것이다. */
+void buffer_cache_zero_sector (disk_sector_t sector_idx)
+{
+	struct bfc_entry *bfce;
+
+	bfce = get_pinned(sector_idx, false, true, DISK_IO_DATA);
+	lock_acquire(&bfce->lock);
+	memset(bfce->addr, 0, DISK_SECTOR_SIZE);
+	set_dirty(bfce, true);
+	lock_release(&bfce->lock);
+	put_pinned(bfce);
+}
+
+/* hash에서 sector에 해당하는 entry를 찾는다. bfc_lock이나 index_lock을
+   잡은 상태에서 호출 */
+static struct bfc_entry *look_up_locked (disk_sector_t sector_idx)
+{
+	struct bfc_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector_idx;
+	e = hash_find(&buffer_index, &key.hash_elem);
+
+	return e != NULL ? hash_entry(e, struct bfc_entry, hash_elem) : NULL;
+}
+
+/* sector부터 CNT개의 sector 중 캐시에 있는 것이 있는지 (bfc_lock 필요) */
+static bool any_cached (disk_sector_t sector_idx, size_t cnt)
+{
+	size_t i;
+
+	for (i = 0; i < cnt; i++)
+		if (look_up_locked(sector_idx + i) != NULL)
+			return true;
+	return false;
+}
+
+/* 캐시에 있는 BFCE를 pin하고 LOADING이 끝나기를 기다린다.
+   bfc_lock을 잡고 불러야 하며, 리턴할 때는 bfc_lock을 놓는다. */
+static void pin_loaded (struct bfc_entry *bfce)
+{
+	bfce->num_of_accessor++;
+	while (bfce->state == BFC_LOADING)
+		cond_wait(&bfce->io_done, &bfc_lock);
+	lock_release(&bfc_lock);
+}
+
+/* sector부터 CNT개의 연속된 sector를 캐시를 거치지 않고 BUFFER로 읽는다.
+   캐시에 있는 sector는 그 내용이 disk보다 최신일 수 있으므로 캐시에서
+   복사하고, 없는 sector는 disk에서 바로 읽는다. 어느 쪽이든 캐시에 새로
+   올리거나 다른 entry를 쫓아내지 않는다. 캐시에 있는 sector가 하나도
+   없으면 전체를 한 번의 multi-sector 명령으로 읽는다. */
+void buffer_cache_read_direct (disk_sector_t sector_idx, void *buffer_,
+                               size_t cnt)
+{
+	uint8_t *buffer = buffer_;
+	struct bfc_entry *bfce;
+	size_t i;
+
+	lock_acquire(&bfc_lock);
+	if (!any_cached(sector_idx, cnt)) {
+		lock_release(&bfc_lock);
+		disk_read_multiple(filesys_disk, sector_idx, buffer, cnt, DISK_IO_DATA);
+		return;
+	}
+	lock_release(&bfc_lock);
+
+	for (i = 0; i < cnt; i++, buffer += DISK_SECTOR_SIZE) {
+		lock_acquire(&bfc_lock);
+		bfce = look_up_locked(sector_idx + i);
+		if (bfce == NULL) {
+			lock_release(&bfc_lock);
+			disk_read_multiple(filesys_disk, sector_idx + i, buffer, 1,
+												 DISK_IO_DATA);
+			continue;
+		}
+		pin_loaded(bfce);
+
+		lock_acquire(&bfce->lock);
+		memcpy(buffer, bfce->addr, DISK_SECTOR_SIZE);
+		lock_release(&bfce->lock);
+
+		lock_acquire(&bfc_lock);
+		unpin(bfce);
+		lock_release(&bfc_lock);
+	}
+}
+
+/* BUFFER의 내용을 sector부터 CNT개의 연속된 sector에 캐시를 거치지 않고
+   쓴다. 캐시에 있는 sector는 캐시의 내용도 같이 바꾸고 clean으로
+   만들어서, 나중에 옛 dirty 내용이 write-behind로 덮어쓰지 않도록 한다.
+   캐시에 있는 sector가 하나도 없으면 전체를 한 번에 쓴다. */
+void buffer_cache_write_direct (disk_sector_t sector_idx,
+                                const void *buffer_, size_t cnt)
+{
+	const uint8_t *buffer = buffer_;
+	struct bfc_entry *bfce;
+	struct direct_write dw;
+	size_t i;
+
+	lock_acquire(&bfc_lock);
+	if (!any_cached(sector_idx, cnt)) {
+		dw.sector = sector_idx;
+		dw.cnt = cnt;
+		list_push_back(&direct_writes, &dw.elem);
+		lock_release(&bfc_lock);
+
+		disk_write_multiple(filesys_disk, sector_idx, buffer, cnt, DISK_IO_DATA);
 
+		lock_acquire(&bfc_lock);
+		list_remove(&dw.elem);
+		cond_broadcast(&direct_done, &bfc_lock);
+		lock_release(&bfc_lock);
+		return;
+	}
 	lock_release(&bfc_lock);
+
+	for (i = 0; i < cnt; i++, buffer += DISK_SECTOR_SIZE) {
+		lock_acquire(&bfc_lock);
+		bfce = look_up_locked(sector_idx + i);
+		if (bfce == NULL) {
+			lock_release(&bfc_lock);
+			buffer_cache_write_direct(sector_idx + i, buffer, 1);
+			continue;
+		}
+		pin_loaded(bfce);
+
+		lock_acquire(&bfce->lock);
+		memcpy(bfce->addr, buffer, DISK_SECTOR_SIZE);
+		bfce->writing = true;
+		disk_write_multiple(filesys_disk, sector_idx + i, bfce->addr, 1,
+												DISK_IO_DATA);
+		bfce->writing = false;
+		if (bfce->dirty)
+			set_dirty(bfce, false);
+		lock_release(&bfce->lock);
+
+		lock_acquire(&bfc_lock);
+		unpin(bfce);
+		lock_release(&bfc_lock);
+	}
+}
+
+/* sector에 대한 direct write가 진행 중인지 (bfc_lock 필요) */
+static bool direct_write_pending (disk_sector_t sector_idx)
+{
+	struct list_elem *e;
+
+	for (e = list_begin(&direct_writes); e != list_end(&direct_writes);
+			 e = list_next(e)) {
+		struct direct_write *dw = list_entry(e, struct direct_write, elem);
+		if (sector_idx >= dw->sector && sector_idx - dw->sector < dw->cnt)
+			return true;
+	}
+	return false;
+}
+
+/* buffer_cache에서 sector가 같은 entry를 찾아 리턴
+   만약 원하는 entry를 찾을 수 없으면 NULL 리턴
+   read할 때마다 read-ahead 여부를 정하느라 불리므로 bfc_lock 대신
+   index_lock만 shared로 잡는다. */
+struct bfc_entry *buffer_cache_look_up (disk_sector_t sector_idx)
+{
+  struct bfc_entry *cur;
+ 
+	rwlock_acquire_shared(&index_lock);
+	cur = look_up_locked(sector_idx);
+	rwlock_release_shared(&index_lock);
+
 #ifdef BFC_DEBUG
-	printf("LOOK UP Fail: inode=%x, ofs=%d\n", inode, offset);
+	if (cur != NULL)
+		printf("LOOK UP Success: sector=%u\n", sector_idx);
+	else
+		printf("LOOK UP Fail: sector=%u\n", sector_idx);
 #endif
-  return NULL;
+  return cur;
 }
 
+/* entry가 아직 dirty라면 disk에 쓴다. (그 사이에 다른 스레드가 먼저
+   써버렸을 수도 있으므로 entry lock을 잡고 다시 확인한다.) */
 void buffer_cache_write_behind(struct bfc_entry *bfce)
 {
 	lock_acquire(&bfce->lock);
-	disk_sector_t sector_idx = byte_to_sector(bfce->inode, bfce->offset);
-  disk_write(filesys_disk, sector_idx, bfce->addr);
-	bfce->dirty = false;
-  bfce->accessed = false;
+	if (bfce->dirty && !bfce->journaled) {
+		bfce->writing = true;
+  	disk_write_multiple(filesys_disk, bfce->sector, bfce->addr, 1,
+												bfce->io_class);
+		set_dirty(bfce, false);
+		bfce->writing = false;
+	}
 	lock_release(&bfce->lock);
 
 #ifdef BFC_DEBUG
-	printf("Write-Behind: inode=%x, ofs=%d\n", bfce->inode, bfce->offset);
+	printf("Write-Behind: sector=%u\n", bfce->sector);
 #endif
 }
   
-/* buffer_cache를 순회하며 dirty인 entry를 모두 write-behind */
+/* buffer_cache의 dirty인 entry를 모두 sector 순서대로 write-behind */
 void buffer_cache_write_behind_all()
 {
-  struct list_elem *e;
-  struct bfc_entry *cur;
-	int cnt = 0;
-  disk_sector_t sector_idx;
-
 #ifdef BFC_DEBUG
 	printf("Write-Behind-All START\n");
 #endif
-    
-	lock_acquire(&bfc_lock);
+	flush_dirty();
+}
 
-  for (e = list_begin(&buffer_cache) ; e != list_end(&buffer_cache) ; 
-			 e = list_next(e)) {
-    cur = list_entry(e, struct bfc_entry, elem);
-		cur->accessed = false;
-    if (cur->dirty) {
-			buffer_cache_write_behind(cur);
-			cnt++;
-		}
-  }
+/* sector가 캐시에 dirty로 있으면 write-behind하고 true를 리턴한다.
+   disk에 쓰는 동안에는 bfc_lock 대신 pin으로 entry를 붙잡아둔다. */
+static bool write_behind_sector (disk_sector_t sector_idx)
+{
+	struct bfc_entry *bfce;
 
+	lock_acquire(&bfc_lock);
+	bfce = look_up_locked(sector_idx);
+	if (bfce == NULL || !bfce->dirty || bfce->state != BFC_VALID) {
+		lock_release(&bfc_lock);
+		return false;
+	}
+	bfce->num_of_accessor++;
 	lock_release(&bfc_lock);
 
-#ifdef BFC_DEBUG
-	printf("Write-Behind-All END: count=%d\n", cnt);
-#endif
+	buffer_cache_write_behind(bfce);
+
+	lock_acquire(&bfc_lock);
+	unpin(bfce);
+	lock_release(&bfc_lock);
+	return true;
 }
 
-/* buffer_cache를 순회하며 dirty인 entry를 모두 write-behind */
+/* inode가 가진 sector들(inode 자신의 sector 포함) 중 buffer_cache에
+   dirty로 남아있는 것을 모두 write-behind. entry는 sector로만 구분되므로
+   inode의 sector를 차례로 hash에서 찾는다. */
 void buffer_cache_write_behind_inode(struct inode *inode)
 {
-  struct list_elem *e;
-  struct bfc_entry *cur;
 	int cnt = 0;
-  disk_sector_t sector_idx;
+	off_t ofs;
 
 #ifdef BFC_DEBUG
 	printf("Write-Behind-Inode START: inode=%x\n", inode);
 #endif
 
-	lock_acquire(&bfc_lock);
-
-  for (e = list_begin(&buffer_cache) ; e != list_end(&buffer_cache) ; 
-			 e = list_next(e)) {
-    cur = list_entry(e, struct bfc_entry, elem);
-		if (cur->inode == inode && cur->dirty) {
-			cur->accessed = false;
-		  buffer_cache_write_behind(cur);
+	if (write_behind_sector(inode_get_inumber(inode)))
+		cnt++;
+	for (ofs = 0; ofs < inode_length(inode); ofs += DISK_SECTOR_SIZE) {
+		disk_sector_t sector = byte_to_sector(inode, ofs);
+		if (sector != (disk_sector_t) -1 && write_behind_sector(sector))
 			cnt++;
-		}
-  }
-
-	lock_release(&bfc_lock);
+	}
 
 #ifdef BFC_DEBUG
 	printf("Write-Behind-Inode END: inode=%x, count=%d\n", inode, cnt);
@@ -264,95 +1325,181 @@ void buffer_cache_write_behind_inode(struct inode *inode)
 void buffer_cache_flush ()
 {
   struct list_elem *e;
-  struct bfc_entry *cur;
+  struct bfc_page *pg;
   
+	lock_acquire(&flush_lock);
 	lock_acquire(&bfc_lock);
 
-  while (!list_empty(&buffer_cache))
+	rwlock_acquire_exclusive(&index_lock);
+	hash_clear(&buffer_index, NULL);
+	rwlock_release_exclusive(&index_lock);
+  while (!list_empty(&bfc_pages))
   {
-    e = list_pop_front(&buffer_cache);
-    cur = list_entry(e, struct bfc_entry, elem);
-    free(cur->addr);
-    free(cur);
+    e = list_pop_front(&bfc_pages);
+    pg = list_entry(e, struct bfc_page, elem);
+    palloc_free_page(pg->kpage);
+    free(pg);
   }
+	list_init(&buffer_cache);
+	list_init(&free_entries);
+	list_init(&q_a1in);
+	list_init(&q_am);
+	list_init(&q_a1out);
+	hash_clear(&a1out_index, ghost_free);
+	a1in_cnt = a1out_cnt = 0;
+	entries = 0;
+	capacity = 0;
+	dirty_cnt = 0;
+	cur_victim = NULL;
 
 	lock_release(&bfc_lock);
+	lock_release(&flush_lock);
 #ifdef BFC_DEBUG
 	printf("BufferCache FLUSHED\n");
 #endif
 }
 
-/* 주로 inode_write_at()에 의해 호출된다. */
-uint32_t buffer_cache_write(struct inode *inode, off_t offset,
-														const void *buffer_, int size)
+/* 이제부터 metadata 쓰기를 journal에 모은다. 한 transaction에는 최대
+   MAX개의 sector가 들어간다. (filesys/journal.c의 journal_init()이 호출) */
+void buffer_cache_start_journal (size_t max)
 {
-	struct bfc_entry *bfce;
-	const uint8_t *buffer = buffer_;
-	int sector_ofs = offset % DISK_SECTOR_SIZE;
+	journal_max = max;
+	journaled_cnt = 0;
+}
 
-	//먼저 buffer_cache 내에 원하는 entry가 이미 있는지 검사
-	bfce = buffer_cache_look_up(inode, offset);
+/* journaled entry는 쫓아낼 수 없으므로 캐시의 절반까지만 허용한다. */
+static size_t journal_limit (void)
+{
+	return journal_max < cache_size / 2 ? journal_max : cache_size / 2;
+}
 
-	//만약 새롭게 entry를 할당해야할 경우
-	if (bfce == NULL) {
-		bfce = buffer_cache_get_entry(inode, offset);
-		if (bfce == NULL) //새 entry할당에 실패했을 경우 스레드 종료
-			thread_exit();
+/* metadata를 쓴 entry를 다음 transaction에 넣는다. 마지막 commit 이후에
+   할당된 sector는 commit된 metadata가 아직 가리키지 않으므로 journal에
+   넣지 않고 data처럼 commit 전에 제자리에 쓴다. transaction의 크기는
+   journal_begin()이 미리 예약해서 제한하므로, journal이 넘치는 것은
+   버그이다. (넘친 것을 그냥 dirty로 두면 commit 전에 제자리에 쓰여서
+   atomic하지 않게 된다.) pin하고 entry lock을 잡은 상태에서 호출 */
+static void journal_entry (struct bfc_entry *bfce)
+{
+	enum intr_level old_level;
+
+	if (journal_max == 0 || bfce->journaled || free_map_is_new(bfce->sector))
+		return;
+	old_level = intr_disable();
+	if (journaled_cnt >= journal_max)
+		PANIC ("journal: transaction has more than %zu sectors", journal_max);
+	bfce->journaled = true;
+	journaled_cnt++;
+	intr_set_level(old_level);
+}
+
+/* 지금 transaction에 더 넣을 수 있는 sector의 수. journal_begin()이
+   operation을 시작시키기 전에 확인한다. */
+size_t buffer_cache_journal_room (void)
+{
+	size_t limit = journal_limit();
+
+	return journaled_cnt < limit ? limit - journaled_cnt : 0;
+}
+
+/* 지금 transaction에 journaled entry가 하나도 없는지 */
+bool buffer_cache_journal_empty (void)
+{
+	return journaled_cnt == 0;
+}
+
+/* journaled entry를 최대 MAX개까지, sector 번호는 SECTORS에, 내용은
+   IMAGES에 차례로 복사하고 그 수를 리턴한다. commit 중에는 다른
+   operation이 없으므로 그 사이에 내용이 바뀌지 않는다. */
+size_t buffer_cache_journal_copy (disk_sector_t *sectors, void *images,
+                                  size_t max)
+{
+  struct list_elem *e;
+	struct bfc_entry *cur;
+	size_t cnt = 0;
+
+	lock_acquire(&bfc_lock);
+  for (e = list_begin(&buffer_cache) ; e != list_end(&buffer_cache) && cnt < max;
+			 e = list_next(e)) {
+    cur = list_entry(e, struct bfc_entry, elem);
+		if (!cur->journaled)
+			continue;
+		lock_acquire(&cur->lock);
+		sectors[cnt] = cur->sector;
+		memcpy((uint8_t *) images + cnt * DISK_SECTOR_SIZE, cur->addr,
+					 DISK_SECTOR_SIZE);
+		lock_release(&cur->lock);
+		cnt++;
 	}
+	lock_release(&bfc_lock);
+	return cnt;
+}
 
-	lock_acquire(&bfce->lock);
-	bfce->num_of_accessor++;
+/* transaction이 journal에 commit되었으니 entry들을 제자리에 써도 된다.
+   entry는 dirty로 남으므로 다음 write-behind 때 disk에 쓰인다. */
+void buffer_cache_journal_release (void)
+{
+  struct list_elem *e;
+	struct bfc_entry *cur;
+	enum intr_level old_level;
 
-	// 이제 bfce->addr에 buffer의 데이터를 write한다.
-	memcpy(bfce->addr + sector_ofs, buffer, size);
-	bfce->dirty = true;
-	bfce->accessed = true;
+	lock_acquire(&bfc_lock);
+  for (e = list_begin(&buffer_cache) ; e != list_end(&buffer_cache) ;
+			 e = list_next(e)) {
+    cur = list_entry(e, struct bfc_entry, elem);
+		old_level = intr_disable();
+		if (cur->journaled) {
+			cur->journaled = false;
+			journaled_cnt--;
+		}
+		intr_set_level(old_level);
+	}
+	// journaled라서 쫓아낼 entry를 기다리던 스레드를 깨운다.
+	cond_broadcast(&bfc_unpinned, &bfc_lock);
+	lock_release(&bfc_lock);
+}
 
-	bfce->num_of_accessor--;
-	lock_release(&bfce->lock);
+/* inode의 data를 disk 통계에서 어느 쪽으로 셀지 */
+static enum disk_io_class inode_io_class (struct inode *inode)
+{
+	return inode_is_metadata(inode) ? DISK_IO_META : DISK_IO_DATA;
+}
+
+/* 주로 inode_write_at()에 의해 호출된다. */
+uint32_t buffer_cache_write(struct inode *inode, off_t offset,
+														const void *buffer, int size)
+{
+	int sector_ofs = offset % DISK_SECTOR_SIZE;
+	disk_sector_t sector_idx = byte_to_sector(inode, offset);
+
+	write_sector(sector_idx, buffer, sector_ofs, size, inode_io_class(inode));
 #ifdef BFC_DEBUG
-	printf("MEMCPY for write: inode=%x, ofs=%d\n", inode, offset);
+	printf("MEMCPY for write: sector=%u, ofs=%d\n", sector_idx, sector_ofs);
 #endif
 	return size;
 }
 	
 uint32_t buffer_cache_read(struct inode *inode, off_t offset,
-													 void *buffer_, int size) 
+													 void *buffer, int size) 
 {
-	struct bfc_entry *bfce;
-	const uint8_t *buffer = buffer_;
 	int sector_ofs = offset % DISK_SECTOR_SIZE;
+	disk_sector_t sector_idx = byte_to_sector(inode, offset);
 
-	bfce = buffer_cache_look_up(inode, offset);
-
-	if (bfce == NULL) {
-		bfce = buffer_cache_get_entry(inode, offset);
-		if (bfce == NULL) 
-			thread_exit();
-	}	
-
-	lock_acquire(&bfce->lock);
-	// buffer_는 오프셋까지 고려된 위치, size는 inode_read_at에서 계산된 chunk size.
-	bfce->num_of_accessor++;
-	memcpy(buffer, bfce->addr + sector_ofs, size);
-	bfce->accessed = true;
-	bfce->num_of_accessor--;
-	lock_release(&bfce->lock);
-
+	// buffer는 오프셋까지 고려된 위치, size는 inode_read_at에서 계산된 chunk size.
+	read_sector(sector_idx, buffer, sector_ofs, size, inode_io_class(inode));
 #ifdef BFC_DEBUG
-	printf("MEMCPY for read: inode=%x, ofs=%d\n", inode, offset);
+	printf("MEMCPY for read: sector=%u, ofs=%d\n", sector_idx, sector_ofs);
 #endif
 
-	/* read-ahead 정책을 위해 DISK_SECTOR_SIZE만큼 offset을 증가시키고
-	   해당 부분의 버퍼 캐시를 찾는다. */
-	offset += DISK_SECTOR_SIZE;
-	bfce = buffer_cache_look_up(inode, offset);
-
-	if (bfce == NULL) 
-		bfce = buffer_cache_get_entry(inode, offset);
-#ifdef BFC_DEBUG
-	printf("READ-AHEAD: inode=%x, ofs=%d\n", inode, offset);
-#endif
+	/* read-ahead 정책을 위해 다음 sector를 read_ahead_daemon에게 요청한다.
+	   실제 disk I/O는 daemon이 하므로 여기서는 기다리지 않는다.
+	   아직 한 번도 쓰이지 않은 sector(-1)는 읽을 필요가 없다. */
+	offset = offset - sector_ofs + DISK_SECTOR_SIZE;
+	if (offset < inode_length(inode)) {
+		disk_sector_t next = byte_to_sector(inode, offset);
+		if (next != (disk_sector_t) -1)
+			buffer_cache_read_ahead(next, inode_io_class(inode));
+	}
 
 	return size;
 }
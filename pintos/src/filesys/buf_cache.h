@@ -3,39 +3,95 @@
 
 #include "filesys/inode.h"
 #include "filesys/off_t.h"
+#include "devices/disk.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <cache-stat.h>
+#include <hash.h>
 #include <list.h>
 #include <stdbool.h>
 
-#define BUF_CACHE_SIZE 64
-#define BFC_TICK_FEQ 20
+#define BUF_CACHE_SIZE 64    /* 기본 캐시 크기 (sector 수), -bfc-size로 변경 */
+#define BFC_MIN_SIZE 32      /* 실행 중에 줄일 수 있는 최소 크기 (sector 수) */
+#define BFC_PAGE_SECTORS (PGSIZE / DISK_SECTOR_SIZE) /* page 하나의 sector 수 */
+#define BFC_FLUSH_INTERVAL 100  /* flusher가 깨어나는 기본 주기 (tick) */
+#define BFC_DIRTY_RATIO 50      /* dirty entry가 이 %를 넘으면 바로 flush */
+#define BFC_CLUSTER_PAGES 8     /* 한번에 모아서 쓸 수 있는 최대 page 수 */
+#define BFC_2Q_KIN 25     /* 2Q: A1in이 캐시에서 차지할 수 있는 % */
+#define BFC_2Q_KOUT 50    /* 2Q: A1out에 기억해둘 sector 수 (캐시 대비 %) */
+#define RA_QUEUE_MAX 16   /* 한번에 큐에 쌓아둘 수 있는 read-ahead 요청 수 */
 
+/* 교체 정책 */
+enum bfc_policy
+{
+	BFC_POLICY_CLOCK,   /* clock (second chance) */
+	BFC_POLICY_2Q,      /* 2Q - 순차적인 scan에 강함 */
+	BFC_POLICY_CNT
+};
+
+/* entry 내용의 상태 */
+enum bfc_state
+{
+	BFC_LOADING,    /* disk에서 읽어오는 중 - 내용을 아직 쓸 수 없음 */
+	BFC_VALID       /* 내용이 유효함 */
+};
+
+/* entry의 메타데이터(sector, state, pin, hash/list 연결)는 bfc_lock으로,
+   데이터(addr가 가리키는 sector 내용)는 entry의 lock으로 보호한다. */
 struct bfc_entry
 {
-	struct inode *inode;  //이 entry를 소유하고 있는 inode
-	off_t offset;
-	uint8_t bytes;        //이 entry가 포함하고 있는 데이터의 byte수
-	void *addr;						//이 entry의 실제 데이터가 위치한 곳의 주소
-	uint32_t num_of_accessor;  //이 entry에 접근하고있는 프로세스의 수
+	disk_sector_t sector; //이 entry가 캐싱하고 있는 disk sector (hash의 key)
+	void *addr;						//이 entry의 실제 데이터가 위치한 곳의 주소 (page 안)
+	bool in_use;          //sector를 담고 있는지 (false면 free_entries에 있음)
+	uint32_t num_of_accessor;  //이 entry를 pin하고 있는 스레드의 수 (>0이면 evict 불가)
+	enum bfc_state state;
 	
 	bool dirty;
+	bool writing;         //disk에 write-behind하는 중인지
 	bool accessed;        //이 entry가 read/write되었었는지
 	bool evictable;
 	struct lock lock;
+	struct condition io_done;   //LOADING이 끝나기를 기다리는 스레드들
+	struct hash_elem hash_elem; //sector로 entry를 찾기 위한 hash의 element
 	struct list_elem elem;
+	struct list_elem q_elem;    //2Q의 A1in 또는 Am 리스트의 element
+	bool in_am;                 //2Q: Am에 들어있는지 (false면 A1in)
+	bool prefetched;            //read-ahead로 올라온 뒤 아직 hit되지 않았는지
+	enum disk_io_class io_class;  //disk 통계용 종류 (data/metadata)
+	bool journaled;             //journal에 commit되기 전이라 제자리에 쓰면 안 됨
 };
 
 uint32_t buffer_cache_write (struct inode *, off_t, const void *, int);
 uint32_t buffer_cache_read (struct inode *, off_t, void *, int);
 
-struct bfc_entry *buffer_cache_get_entry (struct inode *, off_t);
-struct bfc_entry *buffer_cache_look_up (struct inode *, off_t);
+/* sector 단위 API: inode.c가 on-disk inode와 index block을 읽고 쓸 때
+   쓴다. caller의 buffer로 복사하므로 entry를 pin한 채 돌려주지 않는다.
+   directory와 free map은 inode를 통해 buffer_cache_read/write를 거친다. */
+void buffer_cache_read_sector (disk_sector_t, void *, int, int);
+void buffer_cache_write_sector (disk_sector_t, const void *, int, int);
+void buffer_cache_zero_sector (disk_sector_t);
+void buffer_cache_read_direct (disk_sector_t, void *, size_t);
+void buffer_cache_write_direct (disk_sector_t, const void *, size_t);
+
+void buffer_cache_read_ahead (disk_sector_t, enum disk_io_class);
+struct bfc_entry *buffer_cache_look_up (disk_sector_t);
 void init_buffer_cache (void);
 void buffer_cache_write_behind (struct bfc_entry *);
 void buffer_cache_write_behind_all (void);
 void buffer_cache_write_behind_inode (struct inode *);
 void buffer_cache_flush (void);
-void check_buffer_cache (void);
+void buffer_cache_tick (void);
+void buffer_cache_set_flush_interval (int);
+void buffer_cache_set_size (size_t);
+size_t buffer_cache_resize (size_t);
+bool buffer_cache_set_policy (const char *);
+void buffer_cache_get_stats (struct cache_stat *);
+void buffer_cache_start_journal (size_t);
+size_t buffer_cache_journal_room (void);
+bool buffer_cache_journal_empty (void);
+size_t buffer_cache_journal_copy (disk_sector_t *, void *, size_t);
+void buffer_cache_journal_release (void);
+void buffer_cache_print_stats (void);
 
 
 #endif
@@ -2,9 +2,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -21,12 +25,123 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directory tree lock.  Held while searching or changing any
+   directory, so that checking a name is unused and adding it, or
+   finding an entry and erasing it, each happen as one step.  It is
+   taken before any inode lock (see inode.c). */
+static struct lock tree_lock;
+
+/* Hashed directories.
+
+   The first sector of a directory holds a dir_header, and each
+   following sector is a bucket of DIR_BUCKET_ENTRIES entries, so
+   searching a bucket reads a single sector.  A name is stored in
+   the first bucket, starting from the one its hash selects, that
+   has a free slot.
+
+   A free slot whose name is empty has never been used.  Removing
+   an entry leaves its name behind, so a lookup can stop at the
+   first never-used slot: an entry is never placed past one.  When
+   three quarters of the slots have been used, the directory is
+   rebuilt with twice as many buckets.
+
+   Directories without the header, such as those written by older
+   kernels, are plain arrays of dir_entry and are still read and
+   updated linearly. */
+
+/* Identifies a directory. */
+#define DIR_HASH_MAGIC 0x44495248
+
+/* Directory entries per bucket, as many as fit in a sector. */
+#define DIR_BUCKET_ENTRIES (DISK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* Header in the first sector of a directory. */
+struct dir_header 
+  {
+    disk_sector_t magic;                /* DIR_HASH_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t used_cnt;                  /* Slots ever used since rebuild. */
+    uint8_t unused[DISK_SECTOR_SIZE - 3 * sizeof (uint32_t)];
+  };
+
+/* One bucket of a directory, exactly one sector. */
+struct dir_bucket 
+  {
+    struct dir_entry entries[DIR_BUCKET_ENTRIES];
+    uint8_t unused[DISK_SECTOR_SIZE
+                   - DIR_BUCKET_ENTRIES * sizeof (struct dir_entry)];
+  };
+
+/* Returns the byte offset of bucket IDX of a directory. */
+static off_t
+bucket_ofs (size_t idx) 
+{
+  return (off_t) (idx + 1) * DISK_SECTOR_SIZE;
+}
+
+/* Reads the header of the directory in INODE into *H.
+   Returns true if it is a hashed directory, false if linear. */
+static bool
+read_header (struct inode *inode, struct dir_header *h) 
+{
+  return (inode_read_at (inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_HASH_MAGIC && h->bucket_cnt > 0);
+}
+
+/* Writes header H to the directory in INODE. */
+static bool
+write_header (struct inode *inode, const struct dir_header *h) 
+{
+  return inode_write_at (inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Lays out a fresh, empty hashed directory with BUCKET_CNT buckets
+   in INODE.  If CLEAR, the buckets are overwritten with empty
+   slots; otherwise they must already read as zeros, as they do in
+   a newly created inode. */
+static bool
+format_hashed (struct inode *inode, size_t bucket_cnt, bool clear) 
+{
+  static const struct dir_bucket empty;
+  struct dir_header h;
+  size_t i;
+
+  for (i = 0; clear && i < bucket_cnt; i++)
+    if (inode_write_at (inode, &empty, sizeof empty, bucket_ofs (i))
+        != sizeof empty)
+      return false;
+
+  memset (&h, 0, sizeof h);
+  h.magic = DIR_HASH_MAGIC;
+  h.bucket_cnt = bucket_cnt;
+  h.used_cnt = 0;
+  return write_header (inode, &h);
+}
+
 /* Create a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) 
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  size_t bucket_cnt = DIV_ROUND_UP (entry_cnt, DIR_BUCKET_ENTRIES);
+  struct inode *inode;
+  bool success;
+
+  ASSERT (sizeof (struct dir_header) == DISK_SECTOR_SIZE);
+  ASSERT (sizeof (struct dir_bucket) == DISK_SECTOR_SIZE);
+
+  if (bucket_cnt == 0)
+    bucket_cnt = 1;
+  if (!inode_create (sector, bucket_ofs (bucket_cnt)))
+    return false;
+
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+  inode_set_metadata (inode);
+  success = format_hashed (inode, bucket_cnt, false);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -39,6 +154,7 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
+      inode_set_metadata (inode);
       return dir;
     }
   else
@@ -83,6 +199,50 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Searches the hashed directory DIR, whose header is H, for NAME.
+   Returns and reports like lookup(). */
+static bool
+lookup_hashed (const struct dir *dir, const struct dir_header *h,
+               const char *name, struct dir_entry *ep, off_t *ofsp) 
+{
+  size_t first = hash_string (name) % h->bucket_cnt;
+  struct dir_bucket *b;
+  size_t probe;
+  bool found = false;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+  for (probe = 0; probe < h->bucket_cnt; probe++) 
+    {
+      size_t idx = (first + probe) % h->bucket_cnt;
+      size_t i;
+
+      if (inode_read_at (dir->inode, b, sizeof *b, bucket_ofs (idx))
+          != sizeof *b)
+        break;
+      for (i = 0; i < DIR_BUCKET_ENTRIES; i++) 
+        {
+          struct dir_entry *e = &b->entries[i];
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = bucket_ofs (idx) + i * sizeof *e;
+              found = true;
+              break;
+            }
+          if (!e->in_use && e->name[0] == '\0')
+            break;
+        }
+      if (i < DIR_BUCKET_ENTRIES)
+        break;
+    }
+  free (b);
+  return found;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,12 +252,16 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir->inode, &h))
+    return lookup_hashed (dir, &h, name, ep, ofsp);
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -111,6 +275,192 @@ lookup (const struct dir *dir, const char *name,
   return false;
 }
 
+/* Name lookup cache.
+
+   Maps a (directory inode sector, name) pair to the sector of the
+   named file's inode, or records that the directory has no such
+   name, so that repeated opens and creates of the same names do
+   not search the directory again.  dir_add() and dir_remove()
+   keep the affected entry up to date.  The least recently used
+   entry is dropped when the cache is full. */
+
+/* Maximum number of cached names. */
+#define DCACHE_SIZE 256
+
+/* A cached name. */
+struct dcache_entry 
+  {
+    struct hash_elem hash_elem;         /* Element in dcache. */
+    struct list_elem lru_elem;          /* Element in dcache_lru. */
+    disk_sector_t dir_sector;           /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    bool present;                       /* False for a negative entry. */
+    disk_sector_t inode_sector;         /* File's inode, if PRESENT. */
+  };
+
+static struct hash dcache;              /* Cached names. */
+static struct list dcache_lru;          /* Most recently used first. */
+static size_t dcache_cnt;               /* Number of entries. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+
+static unsigned
+dcache_hash (const struct hash_elem *e_, void *aux UNUSED) 
+{
+  const struct dcache_entry *e = hash_entry (e_, struct dcache_entry,
+                                             hash_elem);
+  return hash_string (e->name) ^ hash_int (e->dir_sector);
+}
+
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED) 
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+  if (a->dir_sector != b->dir_sector)
+    return a->dir_sector < b->dir_sector;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  hash_init (&dcache, dcache_hash, dcache_less, NULL);
+  list_init (&dcache_lru);
+  dcache_cnt = 0;
+  lock_init (&dcache_lock);
+  lock_init (&tree_lock);
+}
+
+/* Returns the cache entry for NAME in the directory whose inode is
+   at DIR_SECTOR, or a null pointer.  Must hold dcache_lock. */
+static struct dcache_entry *
+dcache_find (disk_sector_t dir_sector, const char *name) 
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  key.dir_sector = dir_sector;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in the directory whose inode is at DIR_SECTOR.
+   Returns true if the cache knows the answer, in which case
+   *PRESENT says whether the name exists and, if so,
+   *INODE_SECTOR is its inode's sector. */
+static bool
+dcache_get (disk_sector_t dir_sector, const char *name,
+            bool *present, disk_sector_t *inode_sector) 
+{
+  struct dcache_entry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  lock_acquire (&dcache_lock);
+  d = dcache_find (dir_sector, name);
+  if (d != NULL)
+    {
+      *present = d->present;
+      *inode_sector = d->inode_sector;
+      list_remove (&d->lru_elem);
+      list_push_front (&dcache_lru, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is at DIR_SECTOR
+   does (PRESENT) or does not exist, with its inode at
+   INODE_SECTOR. */
+static void
+dcache_put (disk_sector_t dir_sector, const char *name, bool present,
+            disk_sector_t inode_sector) 
+{
+  struct dcache_entry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = dcache_find (dir_sector, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else 
+    {
+      if (dcache_cnt < DCACHE_SIZE)
+        {
+          d = malloc (sizeof *d);
+          if (d == NULL)
+            goto done;
+          dcache_cnt++;
+        }
+      else
+        {
+          /* Reuse the least recently used entry. */
+          d = list_entry (list_pop_back (&dcache_lru), struct dcache_entry,
+                          lru_elem);
+          hash_delete (&dcache, &d->hash_elem);
+        }
+      d->dir_sector = dir_sector;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dcache, &d->hash_elem);
+    }
+  d->present = present;
+  d->inode_sector = inode_sector;
+  list_push_front (&dcache_lru, &d->lru_elem);
+
+ done:
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in the directory whose inode
+   is at DIR_SECTOR. */
+static void
+dcache_invalidate (disk_sector_t dir_sector, const char *name) 
+{
+  struct dcache_entry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = dcache_find (dir_sector, name);
+  if (d != NULL)
+    {
+      hash_delete (&dcache, &d->hash_elem);
+      list_remove (&d->lru_elem);
+      dcache_cnt--;
+      free (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Searches DIR for NAME, first in the name cache and then on disk,
+   filling the cache with the answer.  Returns true and sets
+   *INODE_SECTOR if NAME exists. */
+static bool
+cached_lookup (const struct dir *dir, const char *name,
+               disk_sector_t *inode_sector) 
+{
+  disk_sector_t dir_sector = inode_get_inumber (dir->inode);
+  struct dir_entry e;
+  bool present;
+
+  if (dcache_get (dir_sector, name, &present, inode_sector))
+    return present;
+
+  present = lookup (dir, name, &e, NULL);
+  *inode_sector = present ? e.inode_sector : 0;
+  dcache_put (dir_sector, name, present, *inode_sector);
+  return present;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -119,19 +469,175 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  disk_sector_t inode_sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  lock_acquire (&tree_lock);
+  if (cached_lookup (dir, name, &inode_sector))
+    *inode = inode_open (inode_sector);
   else
     *inode = NULL;
+  lock_release (&tree_lock);
 
   return *inode != NULL;
 }
 
+/* Stores entry E in the first free slot of the hashed directory
+   in INODE, whose header is *H, and updates *H on disk, using B to
+   hold a bucket.  Returns false if every slot is in use or on a
+   disk error. */
+static bool
+insert_hashed (struct inode *inode, struct dir_header *h,
+               const struct dir_entry *e, struct dir_bucket *b) 
+{
+  size_t first = hash_string (e->name) % h->bucket_cnt;
+  size_t probe;
+
+  for (probe = 0; probe < h->bucket_cnt; probe++) 
+    {
+      size_t idx = (first + probe) % h->bucket_cnt;
+      size_t i;
+
+      if (inode_read_at (inode, b, sizeof *b, bucket_ofs (idx)) != sizeof *b)
+        return false;
+      for (i = 0; i < DIR_BUCKET_ENTRIES; i++) 
+        if (!b->entries[i].in_use)
+          {
+            off_t ofs = bucket_ofs (idx) + i * sizeof *e;
+
+            if (b->entries[i].name[0] == '\0')
+              {
+                h->used_cnt++;
+                if (!write_header (inode, h))
+                  return false;
+              }
+            return inode_write_at (inode, e, sizeof *e, ofs) == sizeof *e;
+          }
+    }
+  return false;
+}
+
+/* Stores entry E in the first free slot of TABLE, an in-memory
+   copy of the buckets of a hashed directory whose header is *H,
+   and updates *H.  TABLE must have a free slot. */
+static void
+place_entry (struct dir_bucket *table, struct dir_header *h,
+             const struct dir_entry *e) 
+{
+  size_t first = hash_string (e->name) % h->bucket_cnt;
+  size_t probe;
+
+  for (probe = 0; probe < h->bucket_cnt; probe++) 
+    {
+      struct dir_bucket *b = &table[(first + probe) % h->bucket_cnt];
+      size_t i;
+
+      for (i = 0; i < DIR_BUCKET_ENTRIES; i++) 
+        if (!b->entries[i].in_use)
+          {
+            b->entries[i] = *e;
+            h->used_cnt++;
+            return;
+          }
+    }
+  NOT_REACHED ();
+}
+
+/* Rebuilds the hashed directory in INODE, whose header is *H, with
+   twice as many buckets, dropping removed entries, using B to hold
+   a bucket.  Updates *H.
+
+   The new table is built in memory from the old one before any of
+   it is overwritten, so running out of memory or disk space leaves
+   the directory as it was.  Returns false in that case. */
+static bool
+grow_hashed (struct inode *inode, struct dir_header *h, struct dir_bucket *b) 
+{
+  struct dir_header new_h;
+  struct dir_bucket *table;
+  size_t i, j;
+  char zero = 0;
+
+  memset (&new_h, 0, sizeof new_h);
+  new_h.magic = DIR_HASH_MAGIC;
+  new_h.bucket_cnt = h->bucket_cnt * 2;
+  new_h.used_cnt = 0;
+
+  /* Grow the file first, so that running out of space leaves the
+     directory as it was. */
+  if (inode_write_at (inode, &zero, 1, bucket_ofs (new_h.bucket_cnt) - 1)
+      != 1)
+    return false;
+
+  table = calloc (new_h.bucket_cnt, sizeof *table);
+  if (table == NULL)
+    return false;
+  for (i = 0; i < h->bucket_cnt; i++) 
+    {
+      if (inode_read_at (inode, b, sizeof *b, bucket_ofs (i)) != sizeof *b)
+        {
+          free (table);
+          return false;
+        }
+      for (j = 0; j < DIR_BUCKET_ENTRIES; j++)
+        if (b->entries[j].in_use)
+          place_entry (table, &new_h, &b->entries[j]);
+    }
+
+  /* Every sector written below already exists, and the journal
+     commits them together, so the switch is all or nothing. */
+  for (i = 0; i < new_h.bucket_cnt; i++)
+    if (inode_write_at (inode, &table[i], sizeof *table, bucket_ofs (i))
+        != sizeof *table)
+      break;
+  free (table);
+  if (i < new_h.bucket_cnt || !write_header (inode, &new_h))
+    return false;
+  *h = new_h;
+  return true;
+}
+
+/* Returns true if the running journal transaction can take the
+   growth of a directory whose header is H.  Growing rewrites the
+   header, every old bucket, the inode and at most two index
+   blocks; the new buckets are newly allocated and not journaled. */
+static bool
+can_grow (const struct dir_header *h) 
+{
+  return journal_reserve (h->bucket_cnt + 4);
+}
+
+/* Adds entry E to the hashed directory DIR, whose header is *H,
+   growing it first if it is getting full.  If the journal has no
+   room for growing it now, E goes in a free slot if there is one,
+   and the directory grows on a later addition. */
+static bool
+add_hashed (struct dir *dir, struct dir_header *h, const struct dir_entry *e) 
+{
+  size_t slot_cnt = h->bucket_cnt * DIR_BUCKET_ENTRIES;
+  struct dir_bucket *b;
+  bool success;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+  if ((h->used_cnt + 1) * 4 > slot_cnt * 3 && can_grow (h)
+      && !grow_hashed (dir->inode, h, b))
+    success = false;
+  else if (insert_hashed (dir->inode, h, e, b))
+    success = true;
+  else
+    {
+      /* Every slot was in use. */
+      success = (can_grow (h) && grow_hashed (dir->inode, h, b)
+                 && insert_hashed (dir->inode, h, e, b));
+    }
+  free (b);
+  return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -141,7 +647,9 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) 
 {
+  struct dir_header h;
   struct dir_entry e;
+  disk_sector_t existing;
   off_t ofs;
   bool success = false;
   
@@ -152,9 +660,24 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  lock_acquire (&tree_lock);
+
   /* Check NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
-    goto done;
+  if (cached_lookup (dir, name, &existing))
+    {
+      lock_release (&tree_lock);
+      return false;
+    }
+
+  if (read_header (dir->inode, &h))
+    {
+      memset (&e, 0, sizeof e);
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      success = add_hashed (dir, &h, &e);
+      goto done;
+    }
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
@@ -175,6 +698,11 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  if (success)
+    dcache_put (inode_get_inumber (dir->inode), name, true, inode_sector);
+  else
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
+  lock_release (&tree_lock);
   return success;
 }
 
@@ -192,6 +720,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  lock_acquire (&tree_lock);
+
   /* find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -211,7 +741,12 @@ dir_remove (struct dir *dir, const char *name)
   success = true;
 
  done:
+  if (success)
+    dcache_put (inode_get_inumber (dir->inode), name, false, 0);
+  else
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
   inode_close (inode);
+  lock_release (&tree_lock);
   return success;
 }
 
@@ -221,16 +756,31 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool hashed;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  lock_acquire (&tree_lock);
+  hashed = read_header (dir->inode, &h);
+  for (;;) 
     {
+      /* Skip the header and the unused end of each bucket. */
+      off_t slot = dir->pos % DISK_SECTOR_SIZE;
+      if (hashed && (dir->pos < bucket_ofs (0)
+                     || slot + sizeof e > DIR_BUCKET_ENTRIES * sizeof e))
+        dir->pos = ROUND_UP (dir->pos + 1, DISK_SECTOR_SIZE);
+
+      if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+        break;
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         } 
     }
-  return false;
+  lock_release (&tree_lock);
+  return found;
 }
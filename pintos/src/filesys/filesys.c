@@ -7,6 +7,7 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 #include "devices/disk.h"
 
 /* The disk that contains the file system. */
@@ -24,11 +25,13 @@ filesys_init (bool format)
     PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
   inode_init ();
+  dir_init ();
   free_map_init ();
 
   if (format) 
     do_format ();
 
+  journal_init ();
   free_map_open ();
 }
 
@@ -38,6 +41,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_done ();
 	buffer_cache_write_behind_all();
 	buffer_cache_flush();
 }
@@ -51,12 +55,19 @@ filesys_create (const char *name, off_t initial_size)
 {
   disk_sector_t inode_sector = 0;
   struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+
+  /* Place the new inode near its directory's. */
+  disk_sector_t goal = dir != NULL ? inode_get_inumber (dir_get_inode (dir)) : 0;
+  bool success;
+
+  journal_begin ();
+  success = (dir != NULL
+             && free_map_allocate_near (goal, 1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
+  journal_end ();
   dir_close (dir);
 
   return success;
@@ -88,7 +99,11 @@ bool
 filesys_remove (const char *name) 
 {
   struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  bool success;
+
+  journal_begin ();
+  success = dir != NULL && dir_remove (dir, name);
+  journal_end ();
   dir_close (dir); 
 
   return success;
@@ -103,5 +118,6 @@ do_format (void)
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_format ();
   printf ("done.\n");
 }
@@ -1,12 +1,52 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Number of free map bits stored in one sector of the free map
+   file. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
+
+/* The disk is divided into regions of this many sectors, and the
+   number of free sectors in each is kept up to date so that the
+   allocator can skip full regions without scanning them. */
+#define REGION_SECTORS 1024
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static size_t *region_free;          /* Free sectors in each region. */
+static size_t region_cnt;            /* Number of regions. */
+
+/* Sectors of the free map file whose bits have changed since they
+   were last written, one bit per sector.  Allocation and release
+   only mark sectors here; free_map_flush() writes them out. */
+static struct bitmap *dirty_map;
+
+/* Sectors allocated since the free map was last flushed, and
+   sectors released since then.  Nothing committed to the journal
+   refers to a newly allocated sector yet, so metadata written to
+   one need not be journaled (see free_map_is_new()).  A released
+   sector stays allocated until the next flush, which commits the
+   release, so it cannot be reused and overwritten while committed
+   metadata may still refer to it. */
+static struct bitmap *new_map;
+static struct bitmap *released_map;
+
+/* Protects the free map, region counts, dirty map, new map and
+   released map. */
+static struct lock free_map_lock;
+
+/* Serializes free_map_flush(), so that an older copy of a sector
+   cannot be written over a newer one. */
+static struct lock flush_lock;
+
+static void count_regions (void);
 
 /* Initialize the free map. */
 void
@@ -17,6 +57,146 @@ free_map_init (void)
     PANIC ("bitmap creation failed--disk is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_START, JOURNAL_SECTORS, true);
+  lock_init (&free_map_lock);
+  lock_init (&flush_lock);
+
+  region_cnt = DIV_ROUND_UP (bitmap_size (free_map), REGION_SECTORS);
+  region_free = malloc (region_cnt * sizeof *region_free);
+  if (region_free == NULL)
+    PANIC ("free map region table allocation failed");
+  count_regions ();
+
+  dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_size (free_map),
+                                           BITS_PER_SECTOR));
+  if (dirty_map == NULL)
+    PANIC ("free map dirty map allocation failed");
+
+  new_map = bitmap_create (bitmap_size (free_map));
+  released_map = bitmap_create (bitmap_size (free_map));
+  if (new_map == NULL || released_map == NULL)
+    PANIC ("free map allocation failed");
+}
+
+/* Recomputes the free sector count of every region from the
+   bitmap. */
+static void
+count_regions (void) 
+{
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t r;
+
+  for (r = 0; r < region_cnt; r++) 
+    {
+      size_t start = r * REGION_SECTORS;
+      size_t cnt = bit_cnt - start < REGION_SECTORS
+                   ? bit_cnt - start : REGION_SECTORS;
+      region_free[r] = bitmap_count (free_map, start, cnt, false);
+    }
+}
+
+/* Sets the CNT sectors starting at SECTOR to USED in the free map,
+   adjusts the region counts to match, and marks the free map file
+   sectors holding those bits dirty. */
+static void
+mark (disk_sector_t sector, size_t cnt, bool used) 
+{
+  size_t first, last;
+  size_t i;
+
+  ASSERT (cnt > 0);
+
+  bitmap_set_multiple (free_map, sector, cnt, used);
+  for (i = 0; i < cnt; i++)
+    if (used)
+      region_free[(sector + i) / REGION_SECTORS]--;
+    else
+      region_free[(sector + i) / REGION_SECTORS]++;
+
+  first = sector / BITS_PER_SECTOR;
+  last = (sector + cnt - 1) / BITS_PER_SECTOR;
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Returns the first sector at or after START and before END that
+   begins a run of CNT free sectors, or BITMAP_ERROR if there is
+   none.  The run may extend past END. */
+static size_t
+scan_run (size_t start, size_t end, size_t cnt) 
+{
+  size_t bit_cnt = bitmap_size (free_map);
+  size_t i = start;
+
+  while (i < end && i + cnt <= bit_cnt)
+    {
+      size_t j;
+
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (free_map, i + j))
+          break;
+      if (j == cnt)
+        return i;
+
+      /* No run can start at or before the used sector. */
+      i += j + 1;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Returns true if a run of CNT free sectors could start in
+   region R, judging by the free counts of the regions it would
+   cover.  A run no longer than a region is only looked for within
+   one region with enough free sectors; a longer one may cover R
+   and the regions after it. */
+static bool
+may_start_run (size_t r, size_t cnt) 
+{
+  size_t last, free_cnt;
+
+  if (cnt <= REGION_SECTORS)
+    return region_free[r] >= cnt;
+
+  last = r + DIV_ROUND_UP (cnt, REGION_SECTORS);
+  if (last >= region_cnt)
+    last = region_cnt - 1;
+  for (free_cnt = 0; r <= last; r++)
+    free_cnt += region_free[r];
+  return free_cnt >= cnt;
+}
+
+/* Finds a run of CNT free sectors as close after GOAL as possible.
+   Regions are visited in order starting from GOAL's, wrapping
+   around at the end of the disk, and regions in which such a run
+   cannot start are skipped.  Runs of at most a region's length
+   that straddle regions that are each too full are found by a
+   final first-fit scan. */
+static size_t
+find_run (disk_sector_t goal, size_t cnt) 
+{
+  size_t first = goal / REGION_SECTORS;
+  size_t i;
+
+  for (i = 0; i <= region_cnt; i++) 
+    {
+      size_t r = (first + i) % region_cnt;
+      size_t start = r * REGION_SECTORS;
+      size_t end = start + REGION_SECTORS;
+      size_t sector;
+
+      /* The goal's region is searched from GOAL first and, after
+         going all the way around, from its beginning. */
+      if (i == 0)
+        start = goal;
+      else if (i == region_cnt)
+        end = goal;
+
+      if (!may_start_run (r, cnt))
+        continue;
+      sector = scan_run (start, end, cnt);
+      if (sector != BITMAP_ERROR)
+        return sector;
+    }
+  return bitmap_scan (free_map, 0, cnt, false);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -26,44 +206,174 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) 
 {
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (0, cnt, sectorp);
+}
+
+/* Like free_map_allocate(), but picks the CNT consecutive sectors
+   closest after GOAL, such as the sector after a file's last
+   block or its directory's inode, so related sectors stay near
+   each other on disk. */
+bool
+free_map_allocate_near (disk_sector_t goal, size_t cnt,
+                        disk_sector_t *sectorp) 
+{
+  disk_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+  sector = find_run (goal, cnt);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      mark (sector, cnt, true);
+      bitmap_set_multiple (new_map, sector, cnt, true);
     }
+  lock_release (&free_map_lock);
+
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR usable. */
+/* Makes CNT sectors starting at SECTOR usable.  Sectors allocated
+   since the last flush become usable at once; others only at the
+   next flush. */
 void
 free_map_release (disk_sector_t sector, size_t cnt)
 {
+  size_t i;
+
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (new_map, sector + i))
+      {
+        bitmap_reset (new_map, sector + i);
+        mark (sector + i, 1, false);
+      }
+    else
+      {
+        ASSERT (!bitmap_test (released_map, sector + i));
+        bitmap_mark (released_map, sector + i);
+      }
+  lock_release (&free_map_lock);
+}
+
+/* Returns true if SECTOR was allocated since the free map was
+   last flushed. */
+bool
+free_map_is_new (disk_sector_t sector) 
+{
+  bool is_new;
+
+  lock_acquire (&free_map_lock);
+  is_new = bitmap_test (new_map, sector);
+  lock_release (&free_map_lock);
+  return is_new;
+}
+
+/* Returns the number of sectors in the free map file, the most
+   that one flush can write. */
+size_t
+free_map_sector_cnt (void) 
+{
+  return bitmap_size (dirty_map);
+}
+
+/* Frees the sectors released since the last flush and forgets
+   which sectors were newly allocated.  Must hold FREE_MAP_LOCK. */
+static void
+apply_releases (void) 
+{
+  size_t i;
+
+  for (i = bitmap_scan (released_map, 0, 1, true); i != BITMAP_ERROR;
+       i = bitmap_scan (released_map, i + 1, 1, true))
+    mark (i, 1, false);
+  bitmap_set_all (released_map, false);
+  bitmap_set_all (new_map, false);
+}
+
+/* Writes the free map file sectors changed since the last flush.
+   Called by each journal commit, with no file system operation in
+   progress, and when the free map is closed, so a burst of creates
+   and removes costs one write per changed sector rather than one
+   whole-bitmap write each.  Sectors released since the last flush
+   are freed first.
+
+   Each sector is copied out under FREE_MAP_LOCK but written after
+   releasing it, because writing takes the free map inode's lock,
+   which comes before FREE_MAP_LOCK in the lock order (see
+   inode.c).  A sector changed again meanwhile is dirty again and
+   goes out next time. */
+void
+free_map_flush (void) 
+{
+  static uint8_t buf[DISK_SECTOR_SIZE];
+  size_t sector_cnt;
+  size_t i;
+
+  if (dirty_map == NULL)
+    return;
+
+  lock_acquire (&flush_lock);
+  lock_acquire (&free_map_lock);
+  apply_releases ();
+  lock_release (&free_map_lock);
+  sector_cnt = bitmap_size (dirty_map);
+  for (i = 0; free_map_file != NULL && i < sector_cnt; i++) 
+    {
+      size_t size;
+
+      lock_acquire (&free_map_lock);
+      i = bitmap_scan (dirty_map, i, 1, true);
+      if (i == BITMAP_ERROR)
+        {
+          lock_release (&free_map_lock);
+          break;
+        }
+      size = bitmap_copy_range (free_map, i * DISK_SECTOR_SIZE, buf,
+                                DISK_SECTOR_SIZE);
+      bitmap_reset (dirty_map, i);
+      lock_release (&free_map_lock);
+
+      file_write_at (free_map_file, buf, size, (off_t) i * DISK_SECTOR_SIZE);
+    }
+  lock_release (&flush_lock);
+}
+
+/* Opens the free map's inode and marks it as metadata. */
+static struct inode *
+open_free_map_inode (void) 
+{
+  struct inode *inode = inode_open (FREE_MAP_SECTOR);
+  if (inode != NULL)
+    inode_set_metadata (inode);
+  return inode;
 }
 
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void) 
 {
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  free_map_file = file_open (open_free_map_inode ());
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_regions ();
+  bitmap_set_all (dirty_map, false);
+  bitmap_set_all (new_map, false);
+  bitmap_set_all (released_map, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -76,9 +386,10 @@ free_map_create (void)
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  free_map_file = file_open (open_free_map_inode ());
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_map, false);
 }
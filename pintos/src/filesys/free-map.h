@@ -10,8 +10,12 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_flush (void);
 
 bool free_map_allocate (size_t, disk_sector_t *);
+bool free_map_allocate_near (disk_sector_t goal, size_t, disk_sector_t *);
 void free_map_release (disk_sector_t, size_t);
+bool free_map_is_new (disk_sector_t);
+size_t free_map_sector_cnt (void);
 
 #endif /* filesys/free-map.h  */
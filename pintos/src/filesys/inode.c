@@ -1,24 +1,57 @@
 #include "filesys/inode.h"
 #include "filesys/buf_cache.h"
 #include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Maximum number of closed inodes kept in memory. */
+#define INODE_RETAIN_MAX 64
+
+/* Number of data sectors an inode points to directly. */
+#define INODE_DIRECT_CNT 124
+
+/* Number of sector numbers in an index block. */
+#define INODE_PTRS_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
+
+/* Largest number of data sectors an inode can address: the direct
+   sectors, one indirect block, and one doubly indirect block. */
+#define INODE_MAX_SECTORS (INODE_DIRECT_CNT + INODE_PTRS_PER_SECTOR \
+                           + INODE_PTRS_PER_SECTOR * INODE_PTRS_PER_SECTOR)
+
+/* Flag set in a data sector number for a sector that has been
+   allocated but never written.  It reads as zeros without any
+   disk access, and is only cleared (and the sector zeroed in the
+   buffer cache, if only partly overwritten) when first written,
+   so creating or growing a file costs no data sector writes. */
+#define SECTOR_UNWRITTEN 0x80000000u
+
 /* On-disk inode.
-   It must be exactly DISK_SECTOR_SIZE bytes long. */
+   It must be exactly DISK_SECTOR_SIZE bytes long.
+
+   Data sector I is direct[I] for the first INODE_DIRECT_CNT
+   sectors, then entry I - INODE_DIRECT_CNT of the index block at
+   INDIRECT, then an entry in one of the index blocks listed in the
+   index block at DOUBLY_INDIRECT.  A sector number of 0 (the free
+   map inode, which no file can own) means "not allocated", and
+   data sector numbers may carry SECTOR_UNWRITTEN. */
 struct inode_disk
   {
-    disk_sector_t start;                /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    disk_sector_t direct[INODE_DIRECT_CNT];     /* Direct data sectors. */
+    disk_sector_t indirect;             /* Index block of data sectors. */
+    disk_sector_t doubly_indirect;      /* Index block of index blocks. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -32,37 +65,300 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in inode table. */
+    struct list_elem lru_elem;          /* Element in closed_inodes. */
     disk_sector_t sector;               /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    bool meta;                          /* Holds file system metadata? */
+    struct lock lock;                   /* Protects the following. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Returns entry IDX of the index block at sector BLOCK. */
+static disk_sector_t
+index_get (disk_sector_t block, size_t idx) 
+{
+  disk_sector_t sector;
+
+  ASSERT (idx < INODE_PTRS_PER_SECTOR);
+  buffer_cache_read_sector (block, &sector, idx * sizeof sector,
+                            sizeof sector);
+  return sector;
+}
+
+/* Sets entry IDX of the index block at sector BLOCK to SECTOR. */
+static void
+index_set (disk_sector_t block, size_t idx, disk_sector_t sector) 
+{
+  ASSERT (idx < INODE_PTRS_PER_SECTOR);
+  buffer_cache_write_sector (block, &sector, idx * sizeof sector,
+                             sizeof sector);
+}
+
+/* Returns the disk sector that holds data sector IDX of the file
+   described by DISK_INODE, or 0 if it has none.  The result
+   includes SECTOR_UNWRITTEN if the sector has not been written
+   yet.  The direct
+   sectors cost no disk access; others need one index block for
+   the indirect range and two for the doubly indirect range. */
+static disk_sector_t
+lookup_sector (const struct inode_disk *disk_inode, size_t idx) 
+{
+  disk_sector_t block;
+
+  if (idx < INODE_DIRECT_CNT)
+    return disk_inode->direct[idx];
+  idx -= INODE_DIRECT_CNT;
+
+  if (idx < INODE_PTRS_PER_SECTOR)
+    return (disk_inode->indirect != 0
+            ? index_get (disk_inode->indirect, idx) : 0);
+  idx -= INODE_PTRS_PER_SECTOR;
+
+  if (disk_inode->doubly_indirect == 0)
+    return 0;
+  block = index_get (disk_inode->doubly_indirect,
+                     idx / INODE_PTRS_PER_SECTOR);
+  return block != 0 ? index_get (block, idx % INODE_PTRS_PER_SECTOR) : 0;
+}
+
 /* Returns the disk sector that contains byte offset POS within
    INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, including when that byte's sector has never been written
+   and so reads as zero. */
 disk_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
+  disk_sector_t sector;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / DISK_SECTOR_SIZE;
-  else
+  if (pos >= inode->data.length)
     return -1;
+  sector = lookup_sector (&inode->data, pos / DISK_SECTOR_SIZE);
+  return (sector & SECTOR_UNWRITTEN) == 0 ? sector : (disk_sector_t) -1;
+}
+
+/* Makes sure *BLOCK names an index block, allocating and clearing
+   one near GOAL if it is 0.  Returns false if the disk is full. */
+static bool
+ensure_index (disk_sector_t *block, disk_sector_t goal) 
+{
+  static const disk_sector_t zeros[INODE_PTRS_PER_SECTOR];
+
+  if (*block != 0)
+    return true;
+  if (!free_map_allocate_near (goal, 1, block))
+    return false;
+  buffer_cache_write_sector (*block, zeros, 0, DISK_SECTOR_SIZE);
+  return true;
+}
+
+/* Records SECTOR as data sector IDX of DISK_INODE, allocating
+   index blocks as needed, near SECTOR itself.  SECTOR may carry
+   SECTOR_UNWRITTEN.  Returns false if an index block could not be
+   allocated. */
+static bool
+set_sector (struct inode_disk *disk_inode, size_t idx, disk_sector_t sector) 
+{
+  disk_sector_t goal = sector & ~SECTOR_UNWRITTEN;
+  disk_sector_t block;
+
+  if (idx < INODE_DIRECT_CNT)
+    {
+      disk_inode->direct[idx] = sector;
+      return true;
+    }
+  idx -= INODE_DIRECT_CNT;
+
+  if (idx < INODE_PTRS_PER_SECTOR)
+    {
+      if (!ensure_index (&disk_inode->indirect, goal))
+        return false;
+      index_set (disk_inode->indirect, idx, sector);
+      return true;
+    }
+  idx -= INODE_PTRS_PER_SECTOR;
+
+  if (!ensure_index (&disk_inode->doubly_indirect, goal))
+    return false;
+  block = index_get (disk_inode->doubly_indirect,
+                     idx / INODE_PTRS_PER_SECTOR);
+  if (block == 0)
+    {
+      if (!ensure_index (&block, goal))
+        return false;
+      index_set (disk_inode->doubly_indirect, idx / INODE_PTRS_PER_SECTOR,
+                 block);
+    }
+  index_set (block, idx % INODE_PTRS_PER_SECTOR, sector);
+  return true;
+}
+
+/* Grows DISK_INODE to LENGTH bytes, allocating new data sectors
+   marked SECTOR_UNWRITTEN.  The new sectors are first requested
+   from the
+   free map as one run, so a file that grows by large writes stays
+   contiguous; if no such run is free they are allocated one at a
+   time.  Either way they are placed as close as possible after
+   the file's last data sector, or after its inode at INODE_SECTOR
+   if it has none yet.  If the disk fills up, grows the file as far
+   as possible.
+   Returns true if DISK_INODE is now LENGTH bytes long.  The caller
+   must write DISK_INODE back to disk. */
+static bool
+inode_extend (struct inode_disk *disk_inode, disk_sector_t inode_sector,
+              off_t length) 
+{
+  size_t old_sectors = bytes_to_sectors (disk_inode->length);
+  size_t new_sectors = bytes_to_sectors (length);
+  disk_sector_t goal = inode_sector + 1;
+  disk_sector_t run_start = 0;
+  size_t run_left = 0;
+  off_t reached;
+  size_t i;
+
+  if (length <= disk_inode->length)
+    return true;
+  if (new_sectors > INODE_MAX_SECTORS)
+    new_sectors = INODE_MAX_SECTORS;
+  if (old_sectors > 0)
+    goal = (lookup_sector (disk_inode, old_sectors - 1)
+            & ~SECTOR_UNWRITTEN) + 1;
+
+  if (new_sectors > old_sectors
+      && free_map_allocate_near (goal, new_sectors - old_sectors,
+                                 &run_start))
+    run_left = new_sectors - old_sectors;
+
+  for (i = old_sectors; i < new_sectors; i++) 
+    {
+      disk_sector_t sector;
+
+      if (run_left > 0)
+        {
+          sector = run_start++;
+          run_left--;
+        }
+      else if (!free_map_allocate_near (goal, 1, &sector))
+        break;
+      goal = sector + 1;
+
+      if (!set_sector (disk_inode, i, sector | SECTOR_UNWRITTEN))
+        {
+          free_map_release (sector, 1);
+          break;
+        }
+    }
+  if (run_left > 0)
+    free_map_release (run_start, run_left);
+
+  reached = (off_t) i * DISK_SECTOR_SIZE;
+  if (reached > length)
+    reached = length;
+  if (reached > disk_inode->length)
+    disk_inode->length = reached;
+  return disk_inode->length == length;
+}
+
+/* Releases every data sector and index block of DISK_INODE. */
+static void
+inode_release_sectors (const struct inode_disk *disk_inode) 
+{
+  size_t sectors = bytes_to_sectors (disk_inode->length);
+  size_t i;
+
+  for (i = 0; i < sectors; i++) 
+    {
+      disk_sector_t sector = lookup_sector (disk_inode, i)
+                             & ~SECTOR_UNWRITTEN;
+      if (sector != 0)
+        free_map_release (sector, 1);
+    }
+
+  if (disk_inode->indirect != 0)
+    free_map_release (disk_inode->indirect, 1);
+  if (disk_inode->doubly_indirect != 0)
+    {
+      for (i = 0; i < INODE_PTRS_PER_SECTOR; i++) 
+        {
+          disk_sector_t block = index_get (disk_inode->doubly_indirect, i);
+          if (block != 0)
+            free_map_release (block, 1);
+        }
+      free_map_release (disk_inode->doubly_indirect, 1);
+    }
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Table of in-memory inodes, hashed by sector, so that opening a
+   single inode twice returns the same `struct inode'.
+
+   Besides the open inodes, the table keeps up to INODE_RETAIN_MAX
+   inodes whose last opener has closed them, so that reopening a
+   file soon after (as every exec of the same program does) need
+   not read its inode from disk again.  Those have an OPEN_CNT of
+   0 and are also on CLOSED_INODES, least recently closed first.
+
+   INODE_TABLE_LOCK protects the table, CLOSED_INODES, and each
+   inode's OPEN_CNT and REMOVED.  Each inode's own LOCK protects
+   its DATA (length and sector pointers) and DENY_WRITE_CNT, and is
+   held across a whole read or write so that a reader never sees a
+   newly allocated sector before its contents are written.  Locks
+   are taken in the order directory tree lock (see directory.c),
+   INODE_TABLE_LOCK, then an inode's LOCK, then the free map's
+   lock.  Only the free map file's inode is written with the free
+   map lock held, and it never grows.
+
+   Buffers passed to reads and writes must be in kernel memory.
+   A page fault on a user buffer with an inode's LOCK held would
+   wait for the frame table, whose evictor may in turn be writing
+   a memory-mapped page back to the same inode. */
+static struct hash inode_table;
+static struct list closed_inodes;
+static size_t closed_cnt;
+static struct lock inode_table_lock;
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  return hash_int (hash_entry (e, struct inode, hash_elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  return (hash_entry (a, struct inode, hash_elem)->sector
+          < hash_entry (b, struct inode, hash_elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&inode_table, inode_hash, inode_less, NULL);
+  list_init (&closed_inodes);
+  closed_cnt = 0;
+  lock_init (&inode_table_lock);
+}
+
+/* Frees the least recently closed inode.  Returns false if no
+   closed inode is in memory.  Must hold INODE_TABLE_LOCK. */
+static bool
+evict_closed_inode (void) 
+{
+  struct inode *inode;
+
+  if (list_empty (&closed_inodes))
+    return false;
+  inode = list_entry (list_pop_front (&closed_inodes), struct inode,
+                      lru_elem);
+  closed_cnt--;
+  hash_delete (&inode_table, &inode->hash_elem);
+  free (inode);
+  return true;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -85,62 +381,93 @@ inode_create (disk_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
+      disk_inode->length = 0;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start))
+      if (inode_extend (disk_inode, sector, length))
         {
-          disk_write (filesys_disk, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[DISK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                disk_write (filesys_disk, disk_inode->start + i, zeros); 
-            }
+          buffer_cache_write_sector (sector, disk_inode, 0, DISK_SECTOR_SIZE);
           success = true; 
         } 
+      else
+        inode_release_sectors (disk_inode);
       free (disk_inode);
     }
   return success;
 }
 
+/* Returns the in-memory inode for SECTOR, reviving it if it was
+   closed, or a null pointer if it is not in memory.  Must hold
+   INODE_TABLE_LOCK. */
+static struct inode *
+find_open_inode (disk_sector_t sector) 
+{
+  struct hash_elem *e;
+  struct inode key;
+  struct inode *inode;
+
+  key.sector = sector;
+  e = hash_find (&inode_table, &key.hash_elem);
+  if (e == NULL)
+    return NULL;
+  inode = hash_entry (e, struct inode, hash_elem);
+  if (inode->open_cnt == 0)
+    {
+      /* Revive a closed inode. */
+      list_remove (&inode->lru_elem);
+      closed_cnt--;
+    }
+  inode->open_cnt++;
+  return inode;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' which contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) 
 {
-  struct list_elem *e;
   struct inode *inode;
-	struct bfc_entry *bfce;
-	off_t offset;
+  struct inode *found;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already in memory. */
+  lock_acquire (&inode_table_lock);
+  inode = find_open_inode (sector);
+  lock_release (&inode_table_lock);
+  if (inode != NULL)
+    return inode;
+
+  /* Allocate memory, giving up closed inodes if short. */
+  while ((inode = malloc (sizeof *inode)) == NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+      bool evicted;
 
-  /* Allocate memory. */
-  inode = malloc (sizeof *inode);
-  if (inode == NULL)
-    return NULL;
+      lock_acquire (&inode_table_lock);
+      evicted = evict_closed_inode ();
+      lock_release (&inode_table_lock);
+      if (!evicted)
+        return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize, reading the disk without INODE_TABLE_LOCK. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+  inode->meta = false;
+  lock_init (&inode->lock);
+  buffer_cache_read_sector (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+
+  /* Another thread may have opened the same inode meanwhile. */
+  lock_acquire (&inode_table_lock);
+  found = find_open_inode (sector);
+  if (found == NULL)
+    hash_insert (&inode_table, &inode->hash_elem);
+  lock_release (&inode_table_lock);
+  if (found != NULL)
+    {
+      free (inode);
+      inode = found;
+    }
 
   return inode;
 }
@@ -150,7 +477,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inode_table_lock);
+      inode->open_cnt++;
+      lock_release (&inode_table_lock);
+    }
   return inode;
 }
 
@@ -162,32 +493,61 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it in memory
+   for a later inode_open(), or frees it if INODE was a removed
+   inode, in which case its blocks are freed too. */
 void
 inode_close (struct inode *inode) 
 {
+  bool removed;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* If this looks like the last opener, write INODE's dirty
+     sectors behind while our reference still keeps it in memory,
+     without holding INODE_TABLE_LOCK.  Racing with another opener
+     or closer only makes this early write-back wasted or skipped;
+     the buffer cache writes the sectors back later either way. */
+  lock_acquire (&inode_table_lock);
+  if (inode->open_cnt == 1 && !inode->removed)
+    {
+      lock_release (&inode_table_lock);
+      lock_acquire (&inode->lock);
+      buffer_cache_write_behind_inode (inode);
+      lock_release (&inode->lock);
+      lock_acquire (&inode_table_lock);
+    }
+
   /* Release resources if that was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (--inode->open_cnt > 0)
     {
-			// inode를 지우기전에 dirty라면 write-behind
-			buffer_cache_write_behind_inode(inode);
-
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
-        }
+      lock_release (&inode_table_lock);
+      return;
+    }
 
+  /* Keep INODE around unless it is going away. */
+  removed = inode->removed;
+  if (!removed)
+    {
+      list_push_back (&closed_inodes, &inode->lru_elem);
+      if (++closed_cnt > INODE_RETAIN_MAX)
+        evict_closed_inode ();
+    }
+  else
+    hash_delete (&inode_table, &inode->hash_elem);
+  lock_release (&inode_table_lock);
+
+  /* Once out of the table, nobody else can reach a removed inode,
+     so its blocks are released without INODE_TABLE_LOCK, all in
+     one journal transaction. */
+  if (removed)
+    {
+      journal_begin ();
+      inode_release_sectors (&inode->data);
+      free_map_release (inode->sector, 1);
+      journal_end ();
       free (inode); 
     }
 }
@@ -198,22 +558,52 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode_table_lock);
   inode->removed = true;
+  lock_release (&inode_table_lock);
+}
+
+/* Returns the number of whole sectors, starting at sector-aligned
+   OFFSET and covering at most SIZE bytes of INODE's data, that lie
+   on consecutive disk sectors, so they can be moved with one
+   multi-sector transfer.  The first sector must be whole. */
+static size_t
+direct_run (const struct inode *inode, off_t offset, off_t size) 
+{
+  disk_sector_t first = byte_to_sector (inode, offset);
+  size_t cnt = 1;
+
+  ASSERT (offset % DISK_SECTOR_SIZE == 0);
+  for (;;)
+    {
+      offset += DISK_SECTOR_SIZE;
+      size -= DISK_SECTOR_SIZE;
+      if (size < DISK_SECTOR_SIZE
+          || inode_length (inode) - offset < DISK_SECTOR_SIZE
+          || byte_to_sector (inode, offset) != first + cnt)
+        break;
+      cnt++;
+    }
+  return cnt;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   If DIRECT, whole sectors are moved straight from disk into BUFFER
+   without going through (or displacing anything from) the buffer
+   cache; partial sectors still use the cache.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+         bool direct) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
 
+  ASSERT (is_kernel_vaddr (buffer));
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -223,10 +613,25 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
+      disk_sector_t sector_idx;
       if (chunk_size <= 0)
         break;
 
-			buffer_cache_read(inode, offset, buffer + bytes_read, chunk_size);
+      sector_idx = byte_to_sector (inode, offset);
+      if (sector_idx == (disk_sector_t) -1)
+        {
+          /* Never written: reads as zeros. */
+          memset (buffer + bytes_read, 0, chunk_size);
+        }
+      else if (direct && chunk_size == DISK_SECTOR_SIZE)
+        {
+          size_t cnt = direct_run (inode, offset, size);
+
+          buffer_cache_read_direct (sector_idx, buffer + bytes_read, cnt);
+          chunk_size = cnt * DISK_SECTOR_SIZE;
+        }
+      else
+        buffer_cache_read (inode, offset, buffer + bytes_read, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
@@ -237,25 +642,78 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Clears SECTOR_UNWRITTEN from the data sectors of INODE that the
+   SIZE bytes starting at OFFSET touch, which must lie within the
+   file, so they can be written.  A sector that will only be partly
+   overwritten is first zeroed in the buffer cache, which needs no
+   disk read. */
+static void
+mark_written (struct inode *inode, off_t offset, off_t size) 
+{
+  size_t first = offset / DISK_SECTOR_SIZE;
+  size_t last = (offset + size - 1) / DISK_SECTOR_SIZE;
+  bool inode_dirty = false;
+  size_t i;
+
+  ASSERT (size > 0 && offset + size <= inode_length (inode));
+
+  for (i = first; i <= last; i++) 
+    {
+      disk_sector_t sector = lookup_sector (&inode->data, i);
+      off_t sector_start = (off_t) i * DISK_SECTOR_SIZE;
+
+      if ((sector & SECTOR_UNWRITTEN) == 0)
+        continue;
+      sector &= ~SECTOR_UNWRITTEN;
+
+      /* Index blocks already exist, so this cannot fail. */
+      set_sector (&inode->data, i, sector);
+      if (i < INODE_DIRECT_CNT)
+        inode_dirty = true;
+
+      if (offset > sector_start
+          || offset + size < sector_start + DISK_SECTOR_SIZE)
+        buffer_cache_zero_sector (sector);
+    }
+
+  if (inode_dirty)
+    buffer_cache_write_sector (inode->sector, &inode->data, 0,
+                               DISK_SECTOR_SIZE);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   If DIRECT, whole sectors are written straight to disk; see
+   read_at().
+   A write past end of file extends INODE, zero-filling any gap.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+   less than SIZE if the disk fills up. */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
+          off_t offset, bool direct) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
 
+  ASSERT (is_kernel_vaddr (buffer));
   if (inode->deny_write_cnt)
     return 0;
 
+  if (size > 0 && offset + size > inode_length (inode))
+    {
+      inode_extend (&inode->data, inode->sector, offset + size);
+      buffer_cache_write_sector (inode->sector, &inode->data, 0,
+                                 DISK_SECTOR_SIZE);
+    }
+  if (offset >= inode_length (inode))
+    return 0;
+  if (size > inode_length (inode) - offset)
+    size = inode_length (inode) - offset;
+  if (size > 0)
+    mark_written (inode, offset, size);
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -268,7 +726,17 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-			buffer_cache_write(inode, offset, buffer + bytes_written, chunk_size);
+      if (direct && chunk_size == DISK_SECTOR_SIZE)
+        {
+          disk_sector_t sector_idx = byte_to_sector (inode, offset);
+          size_t cnt = direct_run (inode, offset, size);
+
+          buffer_cache_write_direct (sector_idx, buffer + bytes_written, cnt);
+          chunk_size = cnt * DISK_SECTOR_SIZE;
+        }
+      else
+        buffer_cache_write (inode, offset, buffer + bytes_written,
+                            chunk_size);
 
       size -= chunk_size;
       offset += chunk_size;
@@ -278,13 +746,73 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  off_t bytes_read;
+
+  lock_acquire (&inode->lock);
+  bytes_read = read_at (inode, buffer, size, offset, false);
+  lock_release (&inode->lock);
+  return bytes_read;
+}
+
+/* Like inode_read_at(), but sector-aligned whole sectors bypass the
+   buffer cache. */
+off_t
+inode_read_at_direct (struct inode *inode, void *buffer, off_t size,
+                      off_t offset) 
+{
+  off_t bytes_read;
+
+  lock_acquire (&inode->lock);
+  bytes_read = read_at (inode, buffer, size, offset, true);
+  lock_release (&inode->lock);
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   extending INODE if the write goes past end of file.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset) 
+{
+  off_t bytes_written;
+
+  lock_acquire (&inode->lock);
+  bytes_written = write_at (inode, buffer, size, offset, false);
+  lock_release (&inode->lock);
+  return bytes_written;
+}
+
+/* Like inode_write_at(), but sector-aligned whole sectors bypass
+   the buffer cache. */
+off_t
+inode_write_at_direct (struct inode *inode, const void *buffer, off_t size,
+                       off_t offset) 
+{
+  off_t bytes_written;
+
+  lock_acquire (&inode->lock);
+  bytes_written = write_at (inode, buffer, size, offset, true);
+  lock_release (&inode->lock);
+  return bytes_written;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -293,12 +821,31 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
+}
+
+/* Marks INODE as holding file system metadata (a directory or
+   the free map) rather than file data, for disk statistics. */
+void
+inode_set_metadata (struct inode *inode) 
+{
+  inode->meta = true;
+}
+
+/* Returns true if INODE holds file system metadata. */
+bool
+inode_is_metadata (const struct inode *inode) 
+{
+  return inode->meta;
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.  The length only
+   changes under INODE's lock, but a caller that does not hold it
+   may see a length that is already out of date. */
 off_t
 inode_length (const struct inode *inode)
 {
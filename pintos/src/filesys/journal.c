@@ -0,0 +1,381 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/buf_cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Metadata journal.
+
+   Writes of file system metadata (inodes, index blocks,
+   directories and the free map) are held in the buffer cache
+   instead of going to their home sectors.  Periodically, and
+   whenever a transaction gets large, journal_commit() waits for
+   the file system operations in progress to finish, then writes
+   every held sector to the journal in one sequential write:
+
+        descriptor | sector images... | commit record
+
+   Only after that are the sectors written home, and then the
+   journal superblock is updated to say so.  If the system
+   crashes in between, journal_init() finds the committed
+   transaction at the next boot and writes it home again, so each
+   transaction's metadata reaches disk all or nothing.
+
+   File data is not journaled, but it is written out before each
+   commit, so committed metadata never points to data that did
+   not reach the disk.  Neither is metadata in sectors allocated
+   since the last commit, which nothing committed refers to yet.
+
+   A transaction must fit in the journal, and the sectors it holds
+   cannot be evicted from the buffer cache, so each operation
+   reserves room for the sectors it may write when it begins.  An
+   operation that does not fit waits for a commit first, and one
+   that needs more room than usual asks for it with
+   journal_reserve(). */
+
+/* Identifies journal sectors. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Most sectors one transaction can hold: the journal less its
+   superblock, descriptor and commit record. */
+#define JOURNAL_MAX_BLOCKS (JOURNAL_SECTORS - 3)
+
+/* Sectors reserved for each operation.  One write system call
+   chunk changes at most a file's inode and four of its index
+   blocks already on disk; creating or removing a file changes a
+   directory header and one bucket. */
+#define JOURNAL_OP_BLOCKS 8
+
+/* Journal superblock, in sector JOURNAL_START. */
+struct journal_super
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Last transaction written home. */
+    uint32_t unused[126];               /* Not used. */
+  };
+
+/* First sector of a transaction in the journal. */
+struct journal_desc
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction number. */
+    uint32_t cnt;                       /* Number of sector images. */
+    disk_sector_t sectors[125];         /* Home sector of each image. */
+  };
+
+/* Last sector of a transaction in the journal.  The transaction
+   counts as committed only if this is present and matches. */
+struct journal_commit
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Transaction number. */
+    uint32_t checksum;                  /* Over descriptor and images. */
+    uint32_t unused[125];               /* Not used. */
+  };
+
+static bool active;                     /* Journaling enabled? */
+static uint32_t seq;                    /* Last transaction committed. */
+static uint8_t *log_buf;                /* Transaction being written. */
+static size_t log_pages;                /* Pages in LOG_BUF. */
+
+/* Commits wait for operations in progress to end, and new
+   operations wait for a commit in progress to end. */
+static struct lock journal_lock;        /* Protects the following. */
+static int active_ops;                  /* Operations in progress. */
+static size_t reserved;                 /* Sectors they have reserved. */
+static bool committing;                 /* Commit waiting or running? */
+static struct thread *committer;        /* Thread running a commit. */
+static struct condition ops_done;       /* Signaled when ACTIVE_OPS is 0. */
+static struct condition commit_done;    /* Signaled when a commit ends. */
+static struct lock commit_lock;         /* One commit at a time. */
+
+/* If true, journal_done() stops short of writing the final
+   transaction home, as if the machine had crashed right after
+   committing it, so that the next boot has to replay it.  Set by
+   the kernel command-line option -jcrash, for testing. */
+static bool crash_at_done;
+
+/* Returns a checksum of the descriptor and CNT images in BUF. */
+static uint32_t
+checksum (const uint8_t *buf, size_t cnt)
+{
+  const uint32_t *p = (const uint32_t *) buf;
+  size_t words = (cnt + 1) * DISK_SECTOR_SIZE / sizeof *p;
+  uint32_t sum = 0;
+  size_t i;
+
+  for (i = 0; i < words; i++)
+    sum = ((sum << 1) | (sum >> 31)) + p[i];
+  return sum;
+}
+
+/* Writes the journal superblock, recording that transactions up
+   to SEQ have been written home. */
+static void
+write_super (uint32_t seq)
+{
+  static struct journal_super super;
+
+  super.magic = JOURNAL_MAGIC;
+  super.seq = seq;
+  disk_write_multiple (filesys_disk, JOURNAL_START, &super, 1, DISK_IO_META);
+}
+
+/* Writes an empty journal.  Used when formatting. */
+void
+journal_format (void)
+{
+  static struct journal_desc desc;
+
+  ASSERT (sizeof desc == DISK_SECTOR_SIZE);
+  write_super (0);
+  disk_write_multiple (filesys_disk, JOURNAL_START + 1, &desc, 1,
+                       DISK_IO_META);
+}
+
+/* If the journal holds a committed transaction that was not
+   written home before the last shutdown, writes it home. */
+static void
+replay (void)
+{
+  struct journal_desc *desc = (struct journal_desc *) log_buf;
+  struct journal_commit *commit;
+  size_t i;
+
+  disk_read_multiple (filesys_disk, JOURNAL_START + 1, desc, 1,
+                      DISK_IO_META);
+  if (desc->magic != JOURNAL_MAGIC || desc->seq != seq + 1
+      || desc->cnt == 0 || desc->cnt > JOURNAL_MAX_BLOCKS)
+    return;
+
+  disk_read_multiple (filesys_disk, JOURNAL_START + 2,
+                      log_buf + DISK_SECTOR_SIZE, desc->cnt + 1,
+                      DISK_IO_META);
+  commit = (struct journal_commit *)
+           (log_buf + (desc->cnt + 1) * DISK_SECTOR_SIZE);
+  if (commit->magic != JOURNAL_MAGIC || commit->seq != desc->seq
+      || commit->checksum != checksum (log_buf, desc->cnt))
+    return;
+
+  for (i = 0; i < desc->cnt; i++)
+    disk_write_multiple (filesys_disk, desc->sectors[i],
+                         log_buf + (i + 1) * DISK_SECTOR_SIZE, 1,
+                         DISK_IO_META);
+  printf ("journal: replayed transaction %"PRIu32" (%"PRIu32" sectors)\n",
+          desc->seq, desc->cnt);
+  seq = desc->seq;
+  write_super (seq);
+}
+
+/* Initializes the journal: recovers any committed transaction
+   left by a crash and starts journaling metadata writes.  Must
+   be called before the file system is read. */
+void
+journal_init (void)
+{
+  struct journal_super super;
+
+  ASSERT (sizeof super == DISK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_commit) == DISK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  lock_init (&commit_lock);
+  cond_init (&ops_done);
+  cond_init (&commit_done);
+  active_ops = 0;
+  reserved = 0;
+  committing = false;
+  committer = NULL;
+
+  log_pages = DIV_ROUND_UP ((JOURNAL_MAX_BLOCKS + 2) * DISK_SECTOR_SIZE,
+                            PGSIZE);
+  log_buf = palloc_get_multiple (PAL_ASSERT, log_pages);
+
+  disk_read_multiple (filesys_disk, JOURNAL_START, &super, 1, DISK_IO_META);
+  if (super.magic != JOURNAL_MAGIC)
+    PANIC ("file system has no journal; reformat it with -f");
+  seq = super.seq;
+  replay ();
+
+  buffer_cache_start_journal (JOURNAL_MAX_BLOCKS);
+  active = true;
+}
+
+/* Returns true if the running transaction has room for CNT more
+   sectors besides those already reserved and the free map sectors
+   that the commit adds.  Must hold JOURNAL_LOCK. */
+static bool
+has_room (size_t cnt) 
+{
+  return reserved + cnt + free_map_sector_cnt ()
+         <= buffer_cache_journal_room ();
+}
+
+/* Marks the start of a file system operation whose metadata
+   updates must be committed together.  Calls nest.  Must be
+   called before taking any file system lock, because it may wait
+   for a commit. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!active || t == committer || t->journal_depth++ > 0)
+    return;
+
+  /* An empty transaction always takes one operation, so that a
+     small buffer cache still makes progress. */
+  lock_acquire (&journal_lock);
+  for (;;) 
+    {
+      while (committing)
+        cond_wait (&commit_done, &journal_lock);
+      if (has_room (JOURNAL_OP_BLOCKS)
+          || (active_ops == 0 && buffer_cache_journal_empty ()))
+        break;
+      lock_release (&journal_lock);
+      journal_commit ();
+      lock_acquire (&journal_lock);
+    }
+  active_ops++;
+  reserved += JOURNAL_OP_BLOCKS;
+  t->journal_reserved = JOURNAL_OP_BLOCKS;
+  lock_release (&journal_lock);
+}
+
+/* Reserves room for CNT more sectors for the operation in
+   progress, which cannot wait for a commit.  Returns false,
+   reserving nothing, if the running transaction lacks the room. */
+bool
+journal_reserve (size_t cnt) 
+{
+  struct thread *t = thread_current ();
+  bool success;
+
+  if (!active || t == committer)
+    return true;
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  success = has_room (cnt);
+  if (success)
+    {
+      reserved += cnt;
+      t->journal_reserved += cnt;
+    }
+  lock_release (&journal_lock);
+  return success;
+}
+
+/* Marks the end of an operation started with journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!active || t == committer || --t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  reserved -= t->journal_reserved;
+  t->journal_reserved = 0;
+  if (--active_ops == 0)
+    cond_broadcast (&ops_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Commits all metadata written since the last commit to the
+   journal, then, if CHECKPOINT, writes it and all other dirty
+   cached sectors home. */
+static void
+do_commit (bool checkpoint)
+{
+  struct journal_desc *desc = (struct journal_desc *) log_buf;
+  struct journal_commit *commit;
+  size_t cnt;
+
+  if (!active)
+    {
+      free_map_flush ();
+      buffer_cache_write_behind_all ();
+      return;
+    }
+
+  lock_acquire (&commit_lock);
+  lock_acquire (&journal_lock);
+  committing = true;
+  while (active_ops > 0)
+    cond_wait (&ops_done, &journal_lock);
+  committer = thread_current ();
+  lock_release (&journal_lock);
+
+  /* The free map's changes join the transaction, and file data
+     goes to disk ahead of the metadata that refers to it. */
+  free_map_flush ();
+  buffer_cache_write_behind_all ();
+
+  cnt = buffer_cache_journal_copy (desc->sectors,
+                                   log_buf + DISK_SECTOR_SIZE,
+                                   JOURNAL_MAX_BLOCKS);
+  if (cnt > 0)
+    {
+      desc->magic = JOURNAL_MAGIC;
+      desc->seq = seq + 1;
+      desc->cnt = cnt;
+      commit = (struct journal_commit *)
+               (log_buf + (cnt + 1) * DISK_SECTOR_SIZE);
+      memset (commit, 0, sizeof *commit);
+      commit->magic = JOURNAL_MAGIC;
+      commit->seq = seq + 1;
+      commit->checksum = checksum (log_buf, cnt);
+      disk_write_multiple (filesys_disk, JOURNAL_START + 1, log_buf, cnt + 2,
+                           DISK_IO_META);
+      seq++;
+
+      /* Checkpoint. */
+      if (checkpoint)
+        {
+          buffer_cache_journal_release ();
+          buffer_cache_write_behind_all ();
+          write_super (seq);
+        }
+    }
+
+  lock_acquire (&journal_lock);
+  committing = false;
+  committer = NULL;
+  cond_broadcast (&commit_done, &journal_lock);
+  lock_release (&journal_lock);
+  lock_release (&commit_lock);
+}
+
+/* Commits all metadata written since the last commit to the
+   journal, then writes it and all other dirty cached sectors
+   home.  Called by the buffer cache flusher and whenever a
+   transaction fills up. */
+void
+journal_commit (void)
+{
+  do_commit (true);
+}
+
+/* Makes journal_done() simulate a crash; see CRASH_AT_DONE. */
+void
+journal_set_crash (void)
+{
+  crash_at_done = true;
+}
+
+/* Commits the last transaction at shutdown. */
+void
+journal_done (void)
+{
+  do_commit (!crash_at_done);
+}
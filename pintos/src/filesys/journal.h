@@ -0,0 +1,21 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* Sectors of the journal, right after the root directory inode. */
+#define JOURNAL_START 2         /* First journal sector. */
+#define JOURNAL_SECTORS 64      /* Number of journal sectors. */
+
+void journal_init (void);
+void journal_format (void);
+void journal_begin (void);
+bool journal_reserve (size_t);
+void journal_end (void);
+void journal_commit (void);
+void journal_done (void);
+void journal_set_crash (void);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,21 @@
+#ifndef __LIB_CACHE_STAT_H
+#define __LIB_CACHE_STAT_H
+
+#include <stdint.h>
+
+/* Buffer cache statistics, filled in by the cache_stat system call. */
+struct cache_stat
+  {
+    uint64_t hits;              /* Lookups that found the sector cached. */
+    uint64_t misses;            /* Lookups that had to read or zero it. */
+    uint64_t evictions;         /* Sectors evicted to make room. */
+    uint64_t write_backs;       /* Dirty sectors written back to disk. */
+    uint64_t ra_issued;         /* Sectors loaded by read-ahead. */
+    uint64_t ra_used;           /* ...of which were later hit on demand. */
+    uint64_t lookups;           /* Index lookups measured for... */
+    uint64_t lookup_steps;      /* ...total hash chain elements examined. */
+    uint32_t size;              /* Current cache size in sectors. */
+    uint32_t policy;            /* Replacement policy (0 = clock, 1 = 2Q). */
+  };
+
+#endif /* lib/cache-stat.h */
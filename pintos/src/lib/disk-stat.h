@@ -0,0 +1,42 @@
+#ifndef __LIB_DISK_STAT_H
+#define __LIB_DISK_STAT_H
+
+#include <stdint.h>
+
+/* Who a disk request is for, for the per-caller breakdown. */
+enum disk_io_class
+  {
+    DISK_IO_OTHER,              /* Anything not listed below. */
+    DISK_IO_DATA,               /* File data. */
+    DISK_IO_META,               /* Inodes, directories, free map. */
+    DISK_IO_SWAP,               /* Swap pages. */
+    DISK_IO_CLASS_CNT
+  };
+
+/* Number of latency histogram buckets.  Bucket I counts commands
+   that took from 2**I up to 2**(I+1) CPU cycles; the last bucket
+   also counts anything longer. */
+#define DISK_LATENCY_BUCKETS 40
+
+/* Per-caller request statistics. */
+struct disk_class_stat
+  {
+    uint64_t requests;          /* Requests completed. */
+    uint64_t sectors;           /* Sectors transferred. */
+    uint64_t wait_cycles;       /* Total cycles from submission to start. */
+    uint64_t service_cycles;    /* Total cycles from start to completion. */
+  };
+
+/* Statistics for one disk, filled in by the disk_stat system call. */
+struct disk_stat
+  {
+    uint64_t read_cnt;          /* Sectors read. */
+    uint64_t write_cnt;         /* Sectors written. */
+    uint64_t commands;          /* Commands issued, after merging. */
+    uint64_t latency[DISK_LATENCY_BUCKETS];     /* Command latencies. */
+    uint64_t queue_depth_sum;   /* Sum of queue depths seen at submission. */
+    uint32_t queue_depth_max;   /* Deepest queue seen at submission. */
+    struct disk_class_stat class[DISK_IO_CLASS_CNT];
+  };
+
+#endif /* lib/disk-stat.h */
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -359,6 +360,25 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Copies the SIZE bytes of B's file image that start at byte
+   offset OFS into BUF, so that a caller who knows which part of B
+   changed can write just that part to the same place in B's
+   file.  The range is clipped to the end of B.  Returns the
+   number of bytes copied. */
+size_t
+bitmap_copy_range (const struct bitmap *b, size_t ofs, void *buf,
+                   size_t size) 
+{
+  size_t total = byte_cnt (b->bit_cnt);
+
+  if (ofs >= total)
+    return 0;
+  if (size > total - ofs)
+    size = total - ofs;
+  memcpy (buf, (const uint8_t *) b->bits + ofs, size);
+  return size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -134,6 +134,25 @@ hash_find (struct hash *h, struct hash_elem *e)
   return find_elem (h, find_bucket (h, e), e);
 }
 
+/* Returns the number of elements that hash_find() would examine
+   when looking for an element equal to E in hash table H. */
+size_t
+hash_find_length (struct hash *h, struct hash_elem *e) 
+{
+  struct list *bucket = find_bucket (h, e);
+  struct list_elem *i;
+  size_t cnt = 0;
+
+  for (i = list_begin (bucket); i != list_end (bucket); i = list_next (i)) 
+    {
+      struct hash_elem *hi = list_elem_to_hash_elem (i);
+      cnt++;
+      if (!h->less (hi, e, h->aux) && !h->less (e, hi, h->aux))
+        break;
+    }
+  return cnt;
+}
+
 /* Finds, removes, and returns an element equal to E in hash
    table H.  Returns a null pointer if no equal element existed
    in the table.
@@ -28,7 +28,13 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Buffer cache. */
+    SYS_CACHE_STAT,             /* Reads buffer cache statistics. */
+    SYS_DIRECT_IO,              /* Sets cache-bypass mode for a fd. */
+    SYS_DISK_STAT,              /* Reads a disk's I/O statistics. */
+    SYS_CACHE_RESIZE            /* Resizes the buffer cache. */
   };
 
 #endif /* lib/syscall-nr.h */
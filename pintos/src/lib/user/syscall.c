@@ -182,3 +182,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+void
+cache_stat (struct cache_stat *st) 
+{
+  syscall1 (SYS_CACHE_STAT, st);
+}
+
+bool
+direct_io (int fd, bool direct) 
+{
+  return syscall2 (SYS_DIRECT_IO, fd, direct);
+}
+
+bool
+disk_stat (int chan_no, int dev_no, struct disk_stat *st) 
+{
+  return syscall3 (SYS_DISK_STAT, chan_no, dev_no, st);
+}
+
+size_t
+cache_resize (size_t sectors) 
+{
+  return syscall1 (SYS_CACHE_RESIZE, sectors);
+}
@@ -2,7 +2,10 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <cache-stat.h>
+#include <disk-stat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +48,10 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Buffer cache. */
+void cache_stat (struct cache_stat *);
+bool direct_io (int fd, bool direct);
+bool disk_stat (int chan_no, int dev_no, struct disk_stat *);
+size_t cache_resize (size_t sectors);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (65536);
+check_archive ({"hot" => [substr ($data, 0, 4096)],
+                "filler" => [substr ($data, 0, 32768)],
+                "scan" => [$data]});
+pass;
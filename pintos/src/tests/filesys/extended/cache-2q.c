@@ -0,0 +1,63 @@
+/* Checks that the 2Q replacement policy keeps a file that is
+   read more than once in the buffer cache while a file twice the
+   size of the cache is read through once.  Runs with
+   -bfc-policy=2q and a 64-sector cache. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOT_SIZE 4096           /* 8 sectors. */
+#define FILLER_SIZE 32768       /* 64 sectors, the whole cache. */
+#define SCAN_SIZE 65536         /* 128 sectors, twice the cache. */
+static char buf[SCAN_SIZE];
+
+/* Creates NAME holding the first SIZE bytes of BUF, written with
+   direct I/O so that no dirty file data is left in the cache. */
+static void
+write_direct (const char *name, size_t size) 
+{
+  int fd;
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  CHECK (direct_io (fd, true), "enable direct I/O");
+  CHECK (write (fd, buf, size) == (int) size, "write \"%s\" directly", name);
+  msg ("close \"%s\"", name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  struct cache_stat cs;
+  struct disk_stat before, after;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  cache_stat (&cs);
+  CHECK (cs.policy == 1, "cache policy is 2Q");
+
+  write_direct ("hot", HOT_SIZE);
+  write_direct ("filler", FILLER_SIZE);
+  write_direct ("scan", SCAN_SIZE);
+
+  /* The first read puts "hot" in A1in.  Reading "filler" pushes
+     it out while A1out still remembers it, so reading it again
+     moves it to Am. */
+  check_file ("hot", buf, HOT_SIZE);
+  check_file ("filler", buf, FILLER_SIZE);
+  check_file ("hot", buf, HOT_SIZE);
+
+  /* One pass over "scan" should only recycle A1in. */
+  check_file ("scan", buf, SCAN_SIZE);
+
+  CHECK (disk_stat (0, 1, &before), "disk_stat on file system disk");
+  check_file ("hot", buf, HOT_SIZE);
+  CHECK (disk_stat (0, 1, &after), "disk_stat on file system disk");
+  CHECK (after.class[DISK_IO_DATA].sectors
+         - before.class[DISK_IO_DATA].sectors < HOT_SIZE / 512,
+         "\"hot\" stayed in the cache");
+}
@@ -0,0 +1,43 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-2q) begin
+(cache-2q) cache policy is 2Q
+(cache-2q) create "hot"
+(cache-2q) open "hot"
+(cache-2q) enable direct I/O
+(cache-2q) write "hot" directly
+(cache-2q) close "hot"
+(cache-2q) create "filler"
+(cache-2q) open "filler"
+(cache-2q) enable direct I/O
+(cache-2q) write "filler" directly
+(cache-2q) close "filler"
+(cache-2q) create "scan"
+(cache-2q) open "scan"
+(cache-2q) enable direct I/O
+(cache-2q) write "scan" directly
+(cache-2q) close "scan"
+(cache-2q) open "hot" for verification
+(cache-2q) verified contents of "hot"
+(cache-2q) close "hot"
+(cache-2q) open "filler" for verification
+(cache-2q) verified contents of "filler"
+(cache-2q) close "filler"
+(cache-2q) open "hot" for verification
+(cache-2q) verified contents of "hot"
+(cache-2q) close "hot"
+(cache-2q) open "scan" for verification
+(cache-2q) verified contents of "scan"
+(cache-2q) close "scan"
+(cache-2q) disk_stat on file system disk
+(cache-2q) open "hot" for verification
+(cache-2q) verified contents of "hot"
+(cache-2q) close "hot"
+(cache-2q) disk_stat on file system disk
+(cache-2q) "hot" stayed in the cache
+(cache-2q) end
+EOF
+pass;
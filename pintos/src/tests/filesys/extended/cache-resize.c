@@ -0,0 +1,52 @@
+/* Grows and shrinks the buffer cache with cache_resize while a
+   file is being written, then checks that the file is intact and
+   that the cache really changed size. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 4096
+#define CHUNK_CNT 16
+#define FILE_SIZE (CHUNK_SIZE * CHUNK_CNT)
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct cache_stat st;
+  size_t size;
+  int fd;
+  int i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("resized", 0), "create \"resized\"");
+  CHECK ((fd = open ("resized")) > 1, "open \"resized\"");
+  msg ("write \"resized\", resizing the cache between chunks");
+  for (i = 0; i < CHUNK_CNT; i++) 
+    {
+      if (write (fd, buf + i * CHUNK_SIZE, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("write of chunk %d failed", i);
+      cache_resize (i % 2 == 0 ? 32 : 256);
+    }
+  msg ("close \"resized\"");
+  close (fd);
+
+  /* Reading the whole file fills a 256-sector cache past its
+     default size. */
+  check_file ("resized", buf, sizeof buf);
+  cache_stat (&st);
+  CHECK (st.size > 64, "cache grew past its default size");
+
+  size = cache_resize (32);
+  CHECK (size < st.size, "cache_resize shrank the cache");
+  cache_stat (&st);
+  CHECK (st.size == size, "cache_stat agrees with cache_resize");
+
+  check_file ("resized", buf, sizeof buf);
+  cache_stat (&st);
+  CHECK (st.size <= size, "cache stayed small while reading");
+}
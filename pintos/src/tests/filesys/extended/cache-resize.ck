@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-resize) begin
+(cache-resize) create "resized"
+(cache-resize) open "resized"
+(cache-resize) write "resized", resizing the cache between chunks
+(cache-resize) close "resized"
+(cache-resize) open "resized" for verification
+(cache-resize) verified contents of "resized"
+(cache-resize) close "resized"
+(cache-resize) cache grew past its default size
+(cache-resize) cache_resize shrank the cache
+(cache-resize) cache_stat agrees with cache_resize
+(cache-resize) open "resized" for verification
+(cache-resize) verified contents of "resized"
+(cache-resize) close "resized"
+(cache-resize) cache stayed small while reading
+(cache-resize) end
+EOF
+pass;
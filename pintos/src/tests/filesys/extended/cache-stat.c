@@ -0,0 +1,40 @@
+/* Writes a file, reads it back twice, and checks that the
+   cache_stat system call reports the second pass as buffer cache
+   hits. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 4096
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct cache_stat before, after;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("cached", 0), "create \"cached\"");
+  CHECK ((fd = open ("cached")) > 1, "open \"cached\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"cached\"");
+  msg ("close \"cached\"");
+  close (fd);
+
+  check_file ("cached", buf, sizeof buf);
+
+  cache_stat (&before);
+  CHECK (before.size > 0, "cache has sectors");
+  CHECK (before.policy <= 1, "cache policy is clock or 2Q");
+
+  check_file ("cached", buf, sizeof buf);
+
+  cache_stat (&after);
+  CHECK (after.hits >= before.hits + FILE_SIZE / 512,
+         "second read hit the cache");
+}
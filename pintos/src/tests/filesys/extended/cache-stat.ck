@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-stat) begin
+(cache-stat) create "cached"
+(cache-stat) open "cached"
+(cache-stat) write "cached"
+(cache-stat) close "cached"
+(cache-stat) open "cached" for verification
+(cache-stat) verified contents of "cached"
+(cache-stat) close "cached"
+(cache-stat) cache has sectors
+(cache-stat) cache policy is clock or 2Q
+(cache-stat) open "cached" for verification
+(cache-stat) verified contents of "cached"
+(cache-stat) close "cached"
+(cache-stat) second read hit the cache
+(cache-stat) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Checks the directory name cache.  A second lookup of a missing
+   name must be answered without searching the directory again,
+   creating the name must replace the negative entry, and later
+   lookups, including a failed create of the same name, must find
+   the new file. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 1234
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct cache_stat before, between, after;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  cache_stat (&before);
+  CHECK (open ("dentry") == -1, "open \"dentry\" fails");
+  cache_stat (&between);
+  CHECK (open ("dentry") == -1, "open \"dentry\" fails again");
+  cache_stat (&after);
+  CHECK (after.lookups - between.lookups
+         < between.lookups - before.lookups,
+         "second lookup did not search the directory");
+
+  CHECK (create ("dentry", 0), "create \"dentry\"");
+  CHECK ((fd = open ("dentry")) > 1, "open \"dentry\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"dentry\"");
+  msg ("close \"dentry\"");
+  close (fd);
+
+  CHECK (!create ("dentry", 0), "create \"dentry\" again fails");
+  check_file ("dentry", buf, sizeof buf);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dcache) begin
+(dcache) open "dentry" fails
+(dcache) open "dentry" fails again
+(dcache) second lookup did not search the directory
+(dcache) create "dentry"
+(dcache) open "dentry"
+(dcache) write "dentry"
+(dcache) close "dentry"
+(dcache) create "dentry" again fails
+(dcache) open "dentry" for verification
+(dcache) verified contents of "dentry"
+(dcache) close "dentry"
+(dcache) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Writes a file with direct I/O from a buffer that spans several
+   user pages, reads it back the same way, then checks it again
+   through the buffer cache. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (16384 + 1000)
+static char buf[FILE_SIZE];
+static char readback[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (!direct_io (1234, true), "direct_io on bad fd fails");
+
+  CHECK (create ("direct", 0), "create \"direct\"");
+  CHECK ((fd = open ("direct")) > 1, "open \"direct\"");
+  CHECK (direct_io (fd, true), "enable direct I/O");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"direct\" directly");
+  msg ("close \"direct\"");
+  close (fd);
+
+  CHECK ((fd = open ("direct")) > 1, "open \"direct\"");
+  CHECK (direct_io (fd, true), "enable direct I/O");
+  CHECK (read (fd, readback, sizeof readback) == sizeof readback,
+         "read \"direct\" directly");
+  compare_bytes (readback, buf, sizeof buf, 0, "direct");
+  msg ("close \"direct\"");
+  close (fd);
+
+  check_file ("direct", buf, sizeof buf);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(direct-io) begin
+(direct-io) direct_io on bad fd fails
+(direct-io) create "direct"
+(direct-io) open "direct"
+(direct-io) enable direct I/O
+(direct-io) write "direct" directly
+(direct-io) close "direct"
+(direct-io) open "direct"
+(direct-io) enable direct I/O
+(direct-io) read "direct" directly
+(direct-io) close "direct"
+(direct-io) open "direct" for verification
+(direct-io) verified contents of "direct"
+(direct-io) close "direct"
+(direct-io) end
+EOF
+pass;
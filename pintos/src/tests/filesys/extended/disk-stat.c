@@ -0,0 +1,53 @@
+/* Moves a file to and from disk with direct I/O and checks that
+   the disk_stat system call counts the sectors transferred. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTOR_CNT 8
+#define FILE_SIZE (SECTOR_CNT * 512)
+static char buf[FILE_SIZE];
+static char readback[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct disk_stat before, after;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (!disk_stat (2, 0, &before), "disk_stat on bad channel fails");
+  CHECK (!disk_stat (0, 2, &before), "disk_stat on bad device fails");
+
+  CHECK (create ("counted", 0), "create \"counted\"");
+  CHECK ((fd = open ("counted")) > 1, "open \"counted\"");
+  CHECK (direct_io (fd, true), "enable direct I/O");
+
+  CHECK (disk_stat (0, 1, &before), "disk_stat on file system disk");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"counted\" directly");
+  CHECK (disk_stat (0, 1, &after), "disk_stat on file system disk");
+  CHECK (after.write_cnt >= before.write_cnt + SECTOR_CNT,
+         "write counted");
+  CHECK (after.class[DISK_IO_DATA].sectors
+         >= before.class[DISK_IO_DATA].sectors + SECTOR_CNT,
+         "write counted as file data");
+  CHECK (after.commands > before.commands, "commands counted");
+  msg ("close \"counted\"");
+  close (fd);
+
+  CHECK ((fd = open ("counted")) > 1, "open \"counted\"");
+  CHECK (direct_io (fd, true), "enable direct I/O");
+  CHECK (disk_stat (0, 1, &before), "disk_stat on file system disk");
+  CHECK (read (fd, readback, sizeof readback) == sizeof readback,
+         "read \"counted\" directly");
+  CHECK (disk_stat (0, 1, &after), "disk_stat on file system disk");
+  CHECK (after.read_cnt >= before.read_cnt + SECTOR_CNT, "read counted");
+  compare_bytes (readback, buf, sizeof buf, 0, "counted");
+  msg ("close \"counted\"");
+  close (fd);
+}
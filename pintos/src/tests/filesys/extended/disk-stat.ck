@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(disk-stat) begin
+(disk-stat) disk_stat on bad channel fails
+(disk-stat) disk_stat on bad device fails
+(disk-stat) create "counted"
+(disk-stat) open "counted"
+(disk-stat) enable direct I/O
+(disk-stat) disk_stat on file system disk
+(disk-stat) write "counted" directly
+(disk-stat) disk_stat on file system disk
+(disk-stat) write counted
+(disk-stat) write counted as file data
+(disk-stat) commands counted
+(disk-stat) close "counted"
+(disk-stat) open "counted"
+(disk-stat) enable direct I/O
+(disk-stat) disk_stat on file system disk
+(disk-stat) read "counted" directly
+(disk-stat) disk_stat on file system disk
+(disk-stat) read counted
+(disk-stat) close "counted"
+(disk-stat) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+/* Creates 200 files in the root directory, enough to make its
+   hash table double several times, checking each file as it
+   goes. */
+
+#define FILE_CNT 200
+#include "tests/filesys/extended/grow-dir.inc"
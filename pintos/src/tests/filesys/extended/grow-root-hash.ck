@@ -0,0 +1,210 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-root-hash) begin
+(grow-root-hash) creating and checking "file0"
+(grow-root-hash) creating and checking "file1"
+(grow-root-hash) creating and checking "file2"
+(grow-root-hash) creating and checking "file3"
+(grow-root-hash) creating and checking "file4"
+(grow-root-hash) creating and checking "file5"
+(grow-root-hash) creating and checking "file6"
+(grow-root-hash) creating and checking "file7"
+(grow-root-hash) creating and checking "file8"
+(grow-root-hash) creating and checking "file9"
+(grow-root-hash) creating and checking "file10"
+(grow-root-hash) creating and checking "file11"
+(grow-root-hash) creating and checking "file12"
+(grow-root-hash) creating and checking "file13"
+(grow-root-hash) creating and checking "file14"
+(grow-root-hash) creating and checking "file15"
+(grow-root-hash) creating and checking "file16"
+(grow-root-hash) creating and checking "file17"
+(grow-root-hash) creating and checking "file18"
+(grow-root-hash) creating and checking "file19"
+(grow-root-hash) creating and checking "file20"
+(grow-root-hash) creating and checking "file21"
+(grow-root-hash) creating and checking "file22"
+(grow-root-hash) creating and checking "file23"
+(grow-root-hash) creating and checking "file24"
+(grow-root-hash) creating and checking "file25"
+(grow-root-hash) creating and checking "file26"
+(grow-root-hash) creating and checking "file27"
+(grow-root-hash) creating and checking "file28"
+(grow-root-hash) creating and checking "file29"
+(grow-root-hash) creating and checking "file30"
+(grow-root-hash) creating and checking "file31"
+(grow-root-hash) creating and checking "file32"
+(grow-root-hash) creating and checking "file33"
+(grow-root-hash) creating and checking "file34"
+(grow-root-hash) creating and checking "file35"
+(grow-root-hash) creating and checking "file36"
+(grow-root-hash) creating and checking "file37"
+(grow-root-hash) creating and checking "file38"
+(grow-root-hash) creating and checking "file39"
+(grow-root-hash) creating and checking "file40"
+(grow-root-hash) creating and checking "file41"
+(grow-root-hash) creating and checking "file42"
+(grow-root-hash) creating and checking "file43"
+(grow-root-hash) creating and checking "file44"
+(grow-root-hash) creating and checking "file45"
+(grow-root-hash) creating and checking "file46"
+(grow-root-hash) creating and checking "file47"
+(grow-root-hash) creating and checking "file48"
+(grow-root-hash) creating and checking "file49"
+(grow-root-hash) creating and checking "file50"
+(grow-root-hash) creating and checking "file51"
+(grow-root-hash) creating and checking "file52"
+(grow-root-hash) creating and checking "file53"
+(grow-root-hash) creating and checking "file54"
+(grow-root-hash) creating and checking "file55"
+(grow-root-hash) creating and checking "file56"
+(grow-root-hash) creating and checking "file57"
+(grow-root-hash) creating and checking "file58"
+(grow-root-hash) creating and checking "file59"
+(grow-root-hash) creating and checking "file60"
+(grow-root-hash) creating and checking "file61"
+(grow-root-hash) creating and checking "file62"
+(grow-root-hash) creating and checking "file63"
+(grow-root-hash) creating and checking "file64"
+(grow-root-hash) creating and checking "file65"
+(grow-root-hash) creating and checking "file66"
+(grow-root-hash) creating and checking "file67"
+(grow-root-hash) creating and checking "file68"
+(grow-root-hash) creating and checking "file69"
+(grow-root-hash) creating and checking "file70"
+(grow-root-hash) creating and checking "file71"
+(grow-root-hash) creating and checking "file72"
+(grow-root-hash) creating and checking "file73"
+(grow-root-hash) creating and checking "file74"
+(grow-root-hash) creating and checking "file75"
+(grow-root-hash) creating and checking "file76"
+(grow-root-hash) creating and checking "file77"
+(grow-root-hash) creating and checking "file78"
+(grow-root-hash) creating and checking "file79"
+(grow-root-hash) creating and checking "file80"
+(grow-root-hash) creating and checking "file81"
+(grow-root-hash) creating and checking "file82"
+(grow-root-hash) creating and checking "file83"
+(grow-root-hash) creating and checking "file84"
+(grow-root-hash) creating and checking "file85"
+(grow-root-hash) creating and checking "file86"
+(grow-root-hash) creating and checking "file87"
+(grow-root-hash) creating and checking "file88"
+(grow-root-hash) creating and checking "file89"
+(grow-root-hash) creating and checking "file90"
+(grow-root-hash) creating and checking "file91"
+(grow-root-hash) creating and checking "file92"
+(grow-root-hash) creating and checking "file93"
+(grow-root-hash) creating and checking "file94"
+(grow-root-hash) creating and checking "file95"
+(grow-root-hash) creating and checking "file96"
+(grow-root-hash) creating and checking "file97"
+(grow-root-hash) creating and checking "file98"
+(grow-root-hash) creating and checking "file99"
+(grow-root-hash) creating and checking "file100"
+(grow-root-hash) creating and checking "file101"
+(grow-root-hash) creating and checking "file102"
+(grow-root-hash) creating and checking "file103"
+(grow-root-hash) creating and checking "file104"
+(grow-root-hash) creating and checking "file105"
+(grow-root-hash) creating and checking "file106"
+(grow-root-hash) creating and checking "file107"
+(grow-root-hash) creating and checking "file108"
+(grow-root-hash) creating and checking "file109"
+(grow-root-hash) creating and checking "file110"
+(grow-root-hash) creating and checking "file111"
+(grow-root-hash) creating and checking "file112"
+(grow-root-hash) creating and checking "file113"
+(grow-root-hash) creating and checking "file114"
+(grow-root-hash) creating and checking "file115"
+(grow-root-hash) creating and checking "file116"
+(grow-root-hash) creating and checking "file117"
+(grow-root-hash) creating and checking "file118"
+(grow-root-hash) creating and checking "file119"
+(grow-root-hash) creating and checking "file120"
+(grow-root-hash) creating and checking "file121"
+(grow-root-hash) creating and checking "file122"
+(grow-root-hash) creating and checking "file123"
+(grow-root-hash) creating and checking "file124"
+(grow-root-hash) creating and checking "file125"
+(grow-root-hash) creating and checking "file126"
+(grow-root-hash) creating and checking "file127"
+(grow-root-hash) creating and checking "file128"
+(grow-root-hash) creating and checking "file129"
+(grow-root-hash) creating and checking "file130"
+(grow-root-hash) creating and checking "file131"
+(grow-root-hash) creating and checking "file132"
+(grow-root-hash) creating and checking "file133"
+(grow-root-hash) creating and checking "file134"
+(grow-root-hash) creating and checking "file135"
+(grow-root-hash) creating and checking "file136"
+(grow-root-hash) creating and checking "file137"
+(grow-root-hash) creating and checking "file138"
+(grow-root-hash) creating and checking "file139"
+(grow-root-hash) creating and checking "file140"
+(grow-root-hash) creating and checking "file141"
+(grow-root-hash) creating and checking "file142"
+(grow-root-hash) creating and checking "file143"
+(grow-root-hash) creating and checking "file144"
+(grow-root-hash) creating and checking "file145"
+(grow-root-hash) creating and checking "file146"
+(grow-root-hash) creating and checking "file147"
+(grow-root-hash) creating and checking "file148"
+(grow-root-hash) creating and checking "file149"
+(grow-root-hash) creating and checking "file150"
+(grow-root-hash) creating and checking "file151"
+(grow-root-hash) creating and checking "file152"
+(grow-root-hash) creating and checking "file153"
+(grow-root-hash) creating and checking "file154"
+(grow-root-hash) creating and checking "file155"
+(grow-root-hash) creating and checking "file156"
+(grow-root-hash) creating and checking "file157"
+(grow-root-hash) creating and checking "file158"
+(grow-root-hash) creating and checking "file159"
+(grow-root-hash) creating and checking "file160"
+(grow-root-hash) creating and checking "file161"
+(grow-root-hash) creating and checking "file162"
+(grow-root-hash) creating and checking "file163"
+(grow-root-hash) creating and checking "file164"
+(grow-root-hash) creating and checking "file165"
+(grow-root-hash) creating and checking "file166"
+(grow-root-hash) creating and checking "file167"
+(grow-root-hash) creating and checking "file168"
+(grow-root-hash) creating and checking "file169"
+(grow-root-hash) creating and checking "file170"
+(grow-root-hash) creating and checking "file171"
+(grow-root-hash) creating and checking "file172"
+(grow-root-hash) creating and checking "file173"
+(grow-root-hash) creating and checking "file174"
+(grow-root-hash) creating and checking "file175"
+(grow-root-hash) creating and checking "file176"
+(grow-root-hash) creating and checking "file177"
+(grow-root-hash) creating and checking "file178"
+(grow-root-hash) creating and checking "file179"
+(grow-root-hash) creating and checking "file180"
+(grow-root-hash) creating and checking "file181"
+(grow-root-hash) creating and checking "file182"
+(grow-root-hash) creating and checking "file183"
+(grow-root-hash) creating and checking "file184"
+(grow-root-hash) creating and checking "file185"
+(grow-root-hash) creating and checking "file186"
+(grow-root-hash) creating and checking "file187"
+(grow-root-hash) creating and checking "file188"
+(grow-root-hash) creating and checking "file189"
+(grow-root-hash) creating and checking "file190"
+(grow-root-hash) creating and checking "file191"
+(grow-root-hash) creating and checking "file192"
+(grow-root-hash) creating and checking "file193"
+(grow-root-hash) creating and checking "file194"
+(grow-root-hash) creating and checking "file195"
+(grow-root-hash) creating and checking "file196"
+(grow-root-hash) creating and checking "file197"
+(grow-root-hash) creating and checking "file198"
+(grow-root-hash) creating and checking "file199"
+(grow-root-hash) end
+EOF
+pass;
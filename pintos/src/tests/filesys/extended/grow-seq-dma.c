@@ -0,0 +1,6 @@
+/* Grows a file from 0 bytes to 72,943 bytes, 1,234 bytes at a
+   time, with the kernel moving sectors to and from the disk by
+   bus-master DMA instead of programmed I/O. */
+
+#define TEST_SIZE 72943
+#include "tests/filesys/extended/grow-seq.inc"
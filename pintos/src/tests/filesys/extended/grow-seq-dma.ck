@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-seq-dma) begin
+(grow-seq-dma) create "testme"
+(grow-seq-dma) open "testme"
+(grow-seq-dma) writing "testme"
+(grow-seq-dma) close "testme"
+(grow-seq-dma) open "testme" for verification
+(grow-seq-dma) verified contents of "testme"
+(grow-seq-dma) close "testme"
+(grow-seq-dma) end
+EOF
+pass;
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+fail "journal was not replayed at boot\n"
+  if !grep (/^journal: replayed transaction \d+ \(\d+ sectors\)$/, @output);
+check_archive ({"replayed" => [random_bytes (1234)], "empty" => ['']});
+pass;
@@ -0,0 +1,30 @@
+/* Creates and writes two files, then exits.  The kernel runs with
+   -jcrash, so at shutdown it commits the creates to the journal
+   but does not write the root directory or free map home.  The
+   persistence check boots again, which must replay the journal
+   for the files to be found. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 1234
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("replayed", 0), "create \"replayed\"");
+  CHECK ((fd = open ("replayed")) > 1, "open \"replayed\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"replayed\"");
+  msg ("close \"replayed\"");
+  close (fd);
+
+  CHECK (create ("empty", 0), "create \"empty\"");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(journal-replay) begin
+(journal-replay) create "replayed"
+(journal-replay) open "replayed"
+(journal-replay) write "replayed"
+(journal-replay) close "replayed"
+(journal-replay) create "empty"
+(journal-replay) end
+EOF
+pass;
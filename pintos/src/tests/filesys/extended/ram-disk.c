@@ -0,0 +1,50 @@
+/* Runs with the file system and the swap device on RAM disks
+   (-ramfs, -ramswap) and a user pool too small for MEM, then
+   checks that file data and swapped-out pages come back intact
+   and that disk_stat counts the traffic on both RAM disks. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 65536         /* Twice the buffer cache. */
+#define MEM_SIZE (1024 * 1024)  /* Twice the user pool. */
+static char buf[FILE_SIZE];
+static char mem[MEM_SIZE];
+
+void
+test_main (void) 
+{
+  struct disk_stat before, after;
+  size_t i;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (disk_stat (0, 1, &before), "disk_stat on file system disk");
+  CHECK (create ("ram", 0), "create \"ram\"");
+  CHECK ((fd = open ("ram")) > 1, "open \"ram\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"ram\"");
+  msg ("close \"ram\"");
+  close (fd);
+  check_file ("ram", buf, sizeof buf);
+  CHECK (disk_stat (0, 1, &after), "disk_stat on file system disk");
+  CHECK (after.class[DISK_IO_DATA].sectors
+         > before.class[DISK_IO_DATA].sectors,
+         "file data reached the file system disk");
+
+  CHECK (disk_stat (1, 1, &before), "disk_stat on swap disk");
+  msg ("fill memory");
+  for (i = 0; i < MEM_SIZE; i++)
+    mem[i] = i % 251;
+  msg ("check memory");
+  for (i = 0; i < MEM_SIZE; i++)
+    if (mem[i] != (char) (i % 251))
+      fail ("byte %zu != %zu", i, i % 251);
+  CHECK (disk_stat (1, 1, &after), "disk_stat on swap disk");
+  CHECK (after.class[DISK_IO_SWAP].sectors
+         > before.class[DISK_IO_SWAP].sectors,
+         "pages went to the swap disk");
+}
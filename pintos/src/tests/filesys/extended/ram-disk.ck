@@ -0,0 +1,32 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+fail "file system is not on a RAM disk\n"
+  if !grep (/^hd0:1: using 512 kB RAM disk$/, @output);
+fail "swap device is not a RAM disk\n"
+  if !grep (/^hd1:1: using 1,024 kB RAM disk$/, @output);
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ram-disk) begin
+(ram-disk) disk_stat on file system disk
+(ram-disk) create "ram"
+(ram-disk) open "ram"
+(ram-disk) write "ram"
+(ram-disk) close "ram"
+(ram-disk) open "ram" for verification
+(ram-disk) verified contents of "ram"
+(ram-disk) close "ram"
+(ram-disk) disk_stat on file system disk
+(ram-disk) file data reached the file system disk
+(ram-disk) disk_stat on swap disk
+(ram-disk) fill memory
+(ram-disk) check memory
+(ram-disk) disk_stat on swap disk
+(ram-disk) pages went to the swap disk
+(ram-disk) end
+EOF
+pass;
@@ -40,6 +40,7 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #include "filesys/buf_cache.h"
+#include "filesys/journal.h"
 #endif
 
 /* Amount of physical memory, in 4 kB pages. */
@@ -275,6 +276,24 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-dma"))
+        disk_enable_dma ();
+      else if (!strcmp (name, "-ramfs"))
+        disk_use_ram (0, 1, atoi (value));
+      else if (!strcmp (name, "-ramswap"))
+        disk_use_ram (1, 1, atoi (value));
+      else if (!strcmp (name, "-jcrash"))
+        journal_set_crash ();
+      else if (!strcmp (name, "-bfc-flush"))
+        buffer_cache_set_flush_interval (atoi (value));
+      else if (!strcmp (name, "-bfc-size"))
+        buffer_cache_set_size (atoi (value));
+      else if (!strcmp (name, "-bfc-policy"))
+        {
+          if (value == NULL || !buffer_cache_set_policy (value))
+            PANIC ("unknown buffer cache policy \"%s\"",
+                   value != NULL ? value : "");
+        }
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
@@ -394,6 +413,15 @@ usage (void)
           "  -q                 Power off VM after actions or on panic.\n"
           "  -r                 Reboot after actions.\n"
           "  -f                 Format file system disk during startup.\n"
+#ifdef FILESYS
+          "  -dma               Use bus-master IDE DMA if available.\n"
+          "  -ramfs=KB          Put the file system on a KB kB RAM disk (use -f).\n"
+          "  -ramswap=KB        Swap to a KB kB RAM disk.\n"
+          "  -jcrash            Skip the last journal checkpoint, to test replay.\n"
+          "  -bfc-flush=MS      Write back dirty buffer cache blocks every MS ms.\n"
+          "  -bfc-size=KB       Use a KB kB buffer cache (default 32).\n"
+          "  -bfc-policy=NAME   Buffer cache replacement: clock (default) or 2q.\n"
+#endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
@@ -469,6 +497,7 @@ print_stats (void)
   timer_print_stats ();
   thread_print_stats ();
 #ifdef FILESYS
+  buffer_cache_print_stats ();
   disk_print_stats ();
 #endif
   console_print_stats ();
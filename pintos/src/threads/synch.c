@@ -336,3 +336,143 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Returns the slot in the current thread's list of shared
+   holds that contains RWLOCK, or a null pointer if the current
+   thread does not hold RWLOCK in shared mode. */
+static struct rwlock **
+find_shared_hold (const struct rwlock *rwlock) 
+{
+  struct thread *cur = thread_current ();
+  size_t i;
+
+  for (i = 0; i < RWLOCK_SHARED_MAX; i++)
+    if (cur->shared_rwlocks[i] == rwlock)
+      return &cur->shared_rwlocks[i];
+  return NULL;
+}
+
+/* Initializes RWLOCK.  A readers-writer lock may be held either
+   by any number of threads at once in shared mode, or by a
+   single thread in exclusive mode.  Like locks, it is not
+   recursive: a thread must not acquire a readers-writer lock
+   that it already holds, in either mode.
+
+   Writers are preferred: once a thread is waiting to acquire the
+   lock exclusively, new shared acquirers wait behind it, so a
+   steady stream of readers cannot starve writers.  This is also
+   why a thread that holds the lock shared must not try to
+   acquire it shared again: it could wait forever behind a writer
+   that is waiting for it. */
+void
+rwlock_init (struct rwlock *rwlock) 
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->lock);
+  cond_init (&rwlock->readers_ok);
+  cond_init (&rwlock->writer_ok);
+  rwlock->readers = 0;
+  rwlock->waiting_writers = 0;
+  rwlock->writer = NULL;
+}
+
+/* Acquires RWLOCK in shared mode, sleeping while a thread holds
+   it exclusively or is waiting to.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_shared (struct rwlock *rwlock) 
+{
+  struct rwlock **slot;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+  ASSERT (find_shared_hold (rwlock) == NULL);
+
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writer != NULL || rwlock->waiting_writers > 0)
+    cond_wait (&rwlock->readers_ok, &rwlock->lock);
+  rwlock->readers++;
+  lock_release (&rwlock->lock);
+
+  slot = find_shared_hold (NULL);
+  ASSERT (slot != NULL);
+  *slot = rwlock;
+}
+
+/* Releases RWLOCK, which the current thread must hold in shared
+   mode. */
+void
+rwlock_release_shared (struct rwlock *rwlock) 
+{
+  struct rwlock **slot;
+
+  ASSERT (rwlock != NULL);
+
+  slot = find_shared_hold (rwlock);
+  ASSERT (slot != NULL);
+  *slot = NULL;
+
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->writer == NULL);
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0 && rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->writer_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK in exclusive mode, sleeping until no other
+   thread holds it in either mode.  There is no upgrade: a thread
+   that holds RWLOCK shared would wait forever for itself.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_exclusive (struct rwlock *rwlock) 
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+  ASSERT (find_shared_hold (rwlock) == NULL);
+
+  lock_acquire (&rwlock->lock);
+  rwlock->waiting_writers++;
+  while (rwlock->writer != NULL || rwlock->readers > 0)
+    cond_wait (&rwlock->writer_ok, &rwlock->lock);
+  rwlock->waiting_writers--;
+  rwlock->writer = thread_current ();
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread must hold in
+   exclusive mode.  A waiting writer goes next; otherwise every
+   waiting reader is let in. */
+void
+rwlock_release_exclusive (struct rwlock *rwlock) 
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->writer = NULL;
+  if (rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->writer_ok, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->readers_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK in exclusive
+   mode, false otherwise.  Shared holds are recorded per thread in
+   shared_rwlocks, which rwlock_release_shared() and
+   rwlock_acquire_exclusive() check instead. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rwlock) 
+{
+  ASSERT (rwlock != NULL);
+
+  return rwlock->writer == thread_current ();
+}
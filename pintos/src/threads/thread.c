@@ -535,7 +535,7 @@ init_thread (struct thread *t, const char *name, int priority)
 #ifdef VM
 	//Supplemental Page Table 초기화
 	list_init(&t->sup_page_table);
-	lock_init(&t->lock_spt);
+	rwlock_init(&t->lock_spt);
 	//Mapped file 관련 초기화
 	t->mmid = 0;
 	list_init(&t->mf_table);
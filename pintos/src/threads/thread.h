@@ -95,6 +95,10 @@ struct thread
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by synch.c. */
+    struct rwlock *shared_rwlocks[RWLOCK_SHARED_MAX];
+                                        /* Held in shared mode. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
@@ -115,7 +119,7 @@ struct thread
 #ifdef VM
 		struct list sup_page_table;   /* 이 스레드가 갖고 있는 페이지의 리스트
 															    (이 페이지들은 main memory에 없는 것들!) */
-		struct lock lock_spt;			    /* sup_page_table을 위한 lock */
+		struct rwlock lock_spt;		    /* sup_page_table을 위한 lock */
 		
 		struct list mf_table;         /* 이 스레드의 mapped file의 테이블 */
 		uint32_t mmid;								/* 메모리 안의 mapped files의 첫번째 descriptor */
@@ -123,6 +127,12 @@ struct thread
 		struct semaphore sema_pf;     /* page fault를 위한 세마포 */
 #endif
 
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
+    size_t journal_reserved;            /* Journal sectors reserved. */
+#endif
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
 
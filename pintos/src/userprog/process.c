@@ -196,10 +196,8 @@ process_exit (void)
 	}
 /*
 	if (cur->file != NULL) {
-		lock_acquire(&lock_syscall);
 		file_allow_write(cur->file);
 		file_close(cur->file);
-		lock_release(&lock_syscall);
 		cur->file = NULL;
 	}
 */
@@ -348,9 +346,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
 	new_name = list_entry(list_back(&argv), struct parameter, elem); 
 
   /* Open executable file. */
-	lock_acquire(&lock_syscall);
   file = filesys_open (new_name->str);
-	lock_release(&lock_syscall);
 	t->file = file;
 
   if (file == NULL) 
@@ -444,9 +440,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
   /* Start address. */
   *eip = (void (*) (void)) ehdr.e_entry;
 /*
-	lock_acquire(&lock_syscall);
 	file_deny_write(file);
-	lock_release(&lock_syscall);
 */
   success = true;
 
@@ -559,9 +553,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 				thread_current()->max_code_seg_addr = 
 						(void *)((uint32_t)upage + (uint32_t)PGSIZE);
 
-			lock_acquire(&thread_current()->lock_spt);
+			rwlock_acquire_exclusive(&thread_current()->lock_spt);
 			list_push_back(&thread_current()->sup_page_table, &sup_page->elem);
-			lock_release(&thread_current()->lock_spt);
+			rwlock_release_exclusive(&thread_current()->lock_spt);
 #else
       /* Get a page from memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
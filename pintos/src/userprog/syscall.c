@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -9,14 +10,24 @@
 #include "threads/malloc.h"
 #include "devices/input.h"
 #include "threads/synch.h"
-#ifdef VM
+#include "filesys/buf_cache.h"
+#include "filesys/journal.h"
+#include "devices/disk.h"
+#include "threads/palloc.h"
 #include <round.h>
-#include "vm/page.h"
 #include "userprog/pagedir.h"
+#ifdef VM
+#include "vm/page.h"
+#include "vm/frame.h"
 #endif
 
 /* This is a skeleton system call handler */
 
+struct rwlock lock_open_files;
+
+/* read/write가 file과 user buffer 사이에서 한번에 옮기는 최대 page 수 */
+#define BOUNCE_PAGES 8
+
 static void syscall_handler (struct intr_frame *);
 
 // Project 3을 위한 함수
@@ -25,6 +36,12 @@ static int get_user (const uint8_t *uaddr);
 static bool put_user (uint8_t *udst, uint8_t byte);
 static int get_user32 (const uint32_t *uaddr);
 static bool check_phys_base(const void *ptr);
+static void *get_bounce(unsigned size, size_t *pages);
+static char *copy_in_string(const char *ustr);
+static void *pin_user_page(const void *upage);
+static void unpin_user_page(void *kpage);
+static int direct_transfer(struct file *file, uint8_t *buf, unsigned size,
+													 bool write);
 static void check_buf_size(const void *buf, const unsigned size);
 static void check_buf_size_put(const void *buf, const unsigned size);
 static void check_string (char *str_);
@@ -43,6 +60,10 @@ static void close(uint32_t *esp);
 static int handle_mmap(uint32_t *esp);
 static struct mapped_file *find_mapped_file(uint32_t mapid);
 static void handle_munmap(uint32_t *esp);
+static void cache_stat(uint32_t *esp);
+static bool direct_io(uint32_t *esp);
+static bool disk_stat(uint32_t *esp);
+static size_t cache_resize(uint32_t *esp);
 static struct file *find_open_file (struct thread *cur_thread, const int fd);
 static bool remove_open_file (struct thread *cur_thread, const int fd);
 
@@ -50,8 +71,7 @@ static bool remove_open_file (struct thread *cur_thread, const int fd);
 void
 syscall_init (void) 
 {
-	lock_init(&lock_syscall);
-	lock_init(&lock_open_files);
+	rwlock_init(&lock_open_files);
 
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
@@ -103,6 +123,18 @@ syscall_handler (struct intr_frame *f UNUSED)
 			handle_munmap(esp);
 #endif
 			break;
+		case SYS_CACHE_STAT:
+			cache_stat(esp);
+			break;
+		case SYS_DIRECT_IO:
+			f->eax = direct_io(esp);
+			break;
+		case SYS_DISK_STAT:
+			f->eax = disk_stat(esp);
+			break;
+		case SYS_CACHE_RESIZE:
+			f->eax = cache_resize(esp);
+			break;
 		default:
 			printf("system call! : syscall num = %d\n", sys_num);
 			thread_exit();
@@ -155,6 +187,122 @@ static bool check_phys_base(const void *ptr)
 	return true;
 }
 
+/* SIZE 바이트를 옮길 kernel buffer를 BOUNCE_PAGES page까지 할당하고
+   그 page 수를 *PAGES에 넣는다. 메모리가 모자라면 한 page로 나눠 옮기고,
+   한 page도 없으면 NULL을 돌려준다. */
+static void *get_bounce(unsigned size, size_t *pages)
+{
+	void *kbuf;
+
+	*pages = DIV_ROUND_UP(size, PGSIZE);
+	if (*pages > BOUNCE_PAGES)
+		*pages = BOUNCE_PAGES;
+	if (*pages > 1) {
+		kbuf = palloc_get_multiple(0, *pages);
+		if (kbuf != NULL)
+			return kbuf;
+	}
+	*pages = 1;
+	return palloc_get_page(0);
+}
+
+/* user 문자열 USTR을 검사해서 kernel page에 복사한다. 파일 이름은
+   directory lock을 잡은 채로, 또 journal operation 안에서 읽히므로 거기서
+   page fault가 나지 않도록 미리 복사해 둔다. palloc_free_page()로 해제.
+   메모리가 모자라면 NULL */
+static char *copy_in_string(const char *ustr)
+{
+	char *kstr;
+
+	check_string((char *)ustr);
+	kstr = palloc_get_page(0);
+	if (kstr != NULL)
+		strlcpy(kstr, ustr, PGSIZE);
+	return kstr;
+}
+
+/* user page UPAGE가 메모리에 있으면 evict되지 않도록 pin하고 그 kernel
+   주소를 돌려준다. 메모리에 없으면 NULL. (VM이 없으면 evict되지 않는다.) */
+static void *pin_user_page(const void *upage)
+{
+#ifdef VM
+	return frame_table_pin(upage);
+#else
+	return pagedir_get_page(thread_current()->pagedir, upage);
+#endif
+}
+
+/* pin_user_page()로 pin한 page를 놓아준다. */
+static void unpin_user_page(void *kpage UNUSED)
+{
+#ifdef VM
+	frame_table_unpin(kpage);
+#endif
+}
+
+/* direct mode로 연 FILE과 user buffer BUF 사이에서 SIZE 바이트를 옮긴다.
+   WRITE이면 file에 쓰고 아니면 file에서 읽는다. 옮긴 바이트 수를 돌려준다.
+
+   bounce buffer를 거치지 않고, user page들을 pin한 뒤 그 frame의 kernel
+   주소로 disk와 직접 주고받는다. pin하기 전에 page를 미리 건드려서
+   올려 두므로, inode lock이나 journal operation 안에서는 page fault가
+   나지 않는다. */
+static int direct_transfer(struct file *file, uint8_t *buf, unsigned size,
+													 bool write)
+{
+	struct thread *t = thread_current();
+	void *kpages[BOUNCE_PAGES];
+	unsigned done = 0;
+
+	while (done < size) {
+		uint8_t *start = buf + done;
+		uint8_t *upage = pg_round_down(start);
+		unsigned chunk = BOUNCE_PAGES * PGSIZE - pg_ofs(start);
+		size_t cnt, i;
+		bool short_io = false;
+
+		if (chunk > size - done)
+			chunk = size - done;
+		cnt = DIV_ROUND_UP(pg_ofs(start) + chunk, PGSIZE);
+
+		for (i = 0; i < cnt; i++) {
+			uint8_t *u = upage + i * PGSIZE;
+			while ((kpages[i] = pin_user_page(u)) == NULL)
+				if (get_user(u) == -1)
+					thread_exit();
+		}
+
+		if (write)
+			journal_begin();
+		for (i = 0; i < cnt && !short_io; i++) {
+			unsigned ofs = i == 0 ? pg_ofs(start) : 0;
+			unsigned seg = PGSIZE - ofs;
+			off_t n;
+
+			if (seg > size - done)
+				seg = size - done;
+			if (write)
+				n = file_write(file, (uint8_t *)kpages[i] + ofs, seg);
+			else {
+				n = file_read(file, (uint8_t *)kpages[i] + ofs, seg);
+				// kernel 주소로 썼으므로 user page의 dirty bit는 직접 켠다.
+				if (n > 0)
+					pagedir_set_dirty(t->pagedir, upage + i * PGSIZE, true);
+			}
+			done += n;
+			short_io = (unsigned)n < seg;
+		}
+		if (write)
+			journal_end();
+
+		for (i = 0; i < cnt; i++)
+			unpin_user_page(kpages[i]);
+		if (short_io)
+			break;
+	}
+	return (int)done;
+}
+
 /* buf가 가리키는 문자열이 user memory 영역에 있는지 검사한다. */
 static void check_buf_size(const void *buf, const unsigned size)
 {
@@ -264,13 +412,34 @@ static int read(uint32_t *esp)
 		
 		if (file == NULL)
 			return -1;
+		if (file_is_direct(file))
+			return direct_transfer(file, buf, size, false);
+
+		/* inode lock을 잡은 채로 user buffer에서 page fault가 나면, frame
+			 lock을 잡고 mmap된 page를 file에 쓰는 evictor와 deadlock이 생긴다.
+			 그래서 filesys는 kernel buffer로만 읽고, user buffer로의 복사는
+			 lock을 모두 놓은 뒤에 한다. */
+		size_t pages;
+		uint8_t *kbuf = get_bounce(size, &pages);
+		unsigned read_cnt = 0;
+
+		if (kbuf == NULL)
+			return -1;
 
-		int read_cnt;
-		lock_acquire(&lock_syscall);
-		read_cnt = (int)file_read(file, buf, size);
-		lock_release(&lock_syscall);
-
-		return read_cnt;
+		while (read_cnt < size) {
+			unsigned chunk = size - read_cnt;
+			off_t n;
+
+			if (chunk > pages * PGSIZE)
+				chunk = pages * PGSIZE;
+			n = file_read(file, kbuf, chunk);
+			memcpy((uint8_t *)buf + read_cnt, kbuf, n);
+			read_cnt += n;
+			if ((unsigned)n < chunk)
+				break;
+		}
+		palloc_free_multiple(kbuf, pages);
+		return (int)read_cnt;
 	}
 
 	return -1;
@@ -298,12 +467,36 @@ static int write(uint32_t *esp)
 
 		if (file == NULL)
 			return -1;
+		if (file_is_direct(file))
+			return direct_transfer(file, buf, size, true);
 		
-		lock_acquire(&lock_syscall);
-		int write_cnt = file_write(file, buf, size);
-		lock_release(&lock_syscall);
+		/* read()와 마찬가지로 user buffer는 lock 없이 kernel buffer로 먼저
+			 복사한다. 파일 길이와 block 할당이 바뀌면 한 transaction으로
+			 commit하는데, page fault가 journal operation 안에서 나지 않도록
+			 kernel buffer에 쓰는 동안만 transaction을 연다. */
+		size_t pages;
+		uint8_t *kbuf = get_bounce(size, &pages);
+		unsigned write_cnt = 0;
+
+		if (kbuf == NULL)
+			return -1;
 
-		return write_cnt;
+		while (write_cnt < size) {
+			unsigned chunk = size - write_cnt;
+			off_t n;
+
+			if (chunk > pages * PGSIZE)
+				chunk = pages * PGSIZE;
+			memcpy(kbuf, (const uint8_t *)buf + write_cnt, chunk);
+			journal_begin();
+			n = file_write(file, kbuf, chunk);
+			journal_end();
+			write_cnt += n;
+			if ((unsigned)n < chunk)
+				break;
+		}
+		palloc_free_multiple(kbuf, pages);
+		return (int)write_cnt;
 	}
 
 	return -1;
@@ -320,11 +513,12 @@ static bool create(uint32_t *esp)
 	
 	/* filesys_create()는 해당 파일에 대한 inode를 생성하고
 		 현 directory에 inode를 추가한다. */
-	lock_acquire(&lock_syscall);
-	bool ret_value = filesys_create(filename, size);
-	lock_release(&lock_syscall);
-
-	return ret_value;
+	char *kname = copy_in_string(filename);
+	if (kname == NULL)
+		return false;
+	bool success = filesys_create(kname, size);
+	palloc_free_page(kname);
+	return success;
 }
 
 /* 한 thread가 한 file을 여러번 open할 수도 있다.
@@ -337,9 +531,11 @@ static int open(uint32_t *esp)
 	check_phys_base(filename);
 	check_buf_size(filename, sizeof(filename));
 
-	lock_acquire(&lock_syscall);
-	struct file *file = filesys_open(filename);
-	lock_release(&lock_syscall);
+	char *kname = copy_in_string(filename);
+	if (kname == NULL)
+		return -1;
+	struct file *file = filesys_open(kname);
+	palloc_free_page(kname);
 	if (file == NULL)
 		return -1;
 
@@ -349,9 +545,9 @@ static int open(uint32_t *esp)
 	of->fd = cur_thread->next_fd++;
 	of->file = file;
 	
-	lock_acquire(&lock_open_files);
+	rwlock_acquire_exclusive(&lock_open_files);
 	list_push_front(&cur_thread->open_files, &of->elem);
-	lock_release(&lock_open_files);
+	rwlock_release_exclusive(&lock_open_files);
 
 	return of->fd;
 }
@@ -366,11 +562,7 @@ static int filesize(uint32_t *esp)
 	if (file == NULL)
 		return -1;
 
-	lock_acquire(&lock_syscall);
-	int len = (int)file_length(file);
-	lock_release(&lock_syscall);
-
-	return len;
+	return (int)file_length(file);
 }
 
 static void close(uint32_t *esp)
@@ -385,9 +577,7 @@ static void close(uint32_t *esp)
 		thread_exit();
 	}
 
-	lock_acquire(&lock_syscall);
 	file_close(file);
-	lock_release(&lock_syscall);
 
 	if ( !remove_open_file(thread_current(), fd) ) {
 		printf("Fail to remove a file in Open-File-List!\n");
@@ -395,23 +585,86 @@ static void close(uint32_t *esp)
 	}
 }
 
+/* buffer cache 통계를 user가 넘겨준 struct cache_stat에 복사한다. */
+static void cache_stat(uint32_t *esp)
+{
+	struct cache_stat *ust = (struct cache_stat *)extract_arg(++esp);
+	struct cache_stat st;
+
+	check_phys_base(ust);
+	check_phys_base((uint8_t *)ust + sizeof st - 1);
+	check_buf_size_put(ust, sizeof st);
+
+	buffer_cache_get_stats(&st);
+	memcpy(ust, &st, sizeof st);
+}
+
+/* buffer cache의 크기를 바꾸고 실제로 할당되어 있는 sector 수를 돌려준다. */
+static size_t cache_resize(uint32_t *esp)
+{
+	size_t sectors = (size_t)extract_arg(++esp);
+
+	return buffer_cache_resize(sectors);
+}
+
+/* (chan_no, dev_no) disk의 I/O 통계를 user가 넘겨준 struct disk_stat에
+   복사한다. 그런 disk가 없으면 false. */
+static bool disk_stat(uint32_t *esp)
+{
+	int chan_no = (int)extract_arg(++esp);
+	int dev_no = (int)extract_arg(++esp);
+	struct disk_stat *ust = (struct disk_stat *)extract_arg(++esp);
+	struct disk_stat st;
+	struct disk *d;
+
+	check_phys_base(ust);
+	check_phys_base((uint8_t *)ust + sizeof st - 1);
+	check_buf_size_put(ust, sizeof st);
+
+	if (chan_no < 0 || chan_no > 1 || dev_no < 0 || dev_no > 1)
+		return false;
+	d = disk_get(chan_no, dev_no);
+	if (d == NULL)
+		return false;
+	disk_get_stats(d, &st);
+	memcpy(ust, &st, sizeof st);
+	return true;
+}
+
+/* fd로 연 파일의 read/write가 buffer cache를 거치지 않도록(또는 다시
+   거치도록) 한다. sector 단위로 정렬된 큰 파일을 한 번 쭉 읽고 쓸 때
+   캐시를 어지럽히지 않기 위한 것이다. */
+static bool direct_io(uint32_t *esp)
+{
+	int fd = (int)extract_arg(++esp);
+	bool direct = (bool)extract_arg(++esp);
+
+	struct file *file = find_open_file (thread_current(), fd);
+	if (file == NULL)
+		return false;
+
+	file_set_direct(file, direct);
+
+	return true;
+}
+
 /* cur_thread의 open_file_list에서 fd 값을 가지는 파일을 찾아준다. */
 static struct file *find_open_file (struct thread *cur_thread, const int fd)
 {
 	struct list_elem *cur;
 	struct list *open_files = &cur_thread->open_files; 
 
-	lock_acquire(&lock_open_files);
+	rwlock_acquire_shared(&lock_open_files);
 	for (cur = list_begin(open_files) ; cur != list_end(open_files) ;
 			 cur = list_next(cur))
 	{
 		struct open_file *of = list_entry(cur, struct open_file, elem);
 		if (fd == of->fd) {
-			lock_release(&lock_open_files);
+			rwlock_release_shared(&lock_open_files);
 			return of->file;
 		}
 	}
-	lock_release(&lock_open_files);
+	rwlock_release_shared(&lock_open_files);
 
 	return NULL;
 }
@@ -422,7 +675,7 @@ static bool remove_open_file (struct thread *cur_thread, const int fd)
 	struct list_elem *cur;
 	struct list *open_files = &cur_thread->open_files;
 
-	lock_acquire(&lock_open_files);
+	rwlock_acquire_exclusive(&lock_open_files);
 	for (cur = list_begin(open_files) ; cur != list_end(open_files) ;
 			 cur = list_next(cur))
 	{
@@ -430,11 +683,11 @@ static bool remove_open_file (struct thread *cur_thread, const int fd)
 		if (fd == of->fd) {
 			list_remove(cur);
 			free(of);
-			lock_release(&lock_open_files);
+			rwlock_release_exclusive(&lock_open_files);
 			return true;
 		}
 	}
-	lock_release(&lock_open_files);
+	rwlock_release_exclusive(&lock_open_files);
 
 	return false;
 }
@@ -524,9 +777,9 @@ static int handle_mmap (uint32_t *esp)
     p->page = addr;
     p->ofs = (lps++) * PGSIZE;
     
-    lock_acquire(&cur->lock_spt);
+    rwlock_acquire_exclusive(&cur->lock_spt);
     list_push_front(&cur->sup_page_table, &p->elem);
-    lock_release(&cur->lock_spt);
+    rwlock_release_exclusive(&cur->lock_spt);
     
     file_len -= p->read_b;
     addr = (void *)((uint32_t)addr + (uint32_t)PGSIZE);
@@ -563,6 +816,7 @@ static void handle_munmap(uint32_t *esp)
   struct mapped_file *mf;
   int write_b;
   struct page *p;
+  bool written;
   
   cur = thread_current();
   
@@ -585,17 +839,21 @@ static void handle_munmap(uint32_t *esp)
       }
       
       write_b = p->read_b;
+      written = true;
         
-      lock_acquire (&cur->lock_spt);
+      // journal_begin()은 commit을 기다릴 수 있으므로 lock보다 먼저 부른다.
+      journal_begin ();
+      rwlock_acquire_exclusive (&cur->lock_spt);
       kpage = pagedir_get_page(cur->pagedir, p->page);
       if (kpage != NULL) {
-        if(pagedir_is_dirty(cur->pagedir, p->page)) {
-          if(file_write_at(mf->file, kpage, write_b, p->ofs) != write_b)
-            thread_exit ();
-        }
+        if(pagedir_is_dirty(cur->pagedir, p->page))
+          written = file_write_at(mf->file, kpage, write_b, p->ofs) == write_b;
         pagedir_clear_page (cur->pagedir, mf->addr);
       }
-      lock_release (&thread_current ()->lock_spt);
+      rwlock_release_exclusive (&thread_current ()->lock_spt);
+      journal_end ();
+      if (!written)
+        thread_exit ();
       
       supplemental_table_free_page (p);
       size -= write_b;
@@ -5,8 +5,8 @@
 
 void syscall_init (void);
 
-struct lock lock_open_files;
-struct lock lock_syscall;
+/* Protects every thread's open_files list. */
+extern struct rwlock lock_open_files;
 
 
 
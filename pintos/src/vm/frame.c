@@ -8,6 +8,7 @@
 #include <string.h>
 #include "userprog/pagedir.h"
 #include "filesys/file.h"
+#include "filesys/journal.h"
 #include "threads/intr-stubs.h"
 #include "threads/interrupt.h"
 #include "userprog/pagedir.h"
@@ -105,6 +106,7 @@ frame_table_insert (void *_frame, void *upage, bool writable)
   f->page = upage;
   f->writable = writable;
   f->evictable = false;
+  f->pinned = false;
 
   lock_acquire(&lock);
   list_push_front(frame_table (), &f->elem);
@@ -122,6 +124,7 @@ frame_table_get_frame (void *upage, bool writable)
   struct slot *slot;
   struct page *p;
   bool dirty;
+  bool written = true;
   enum intr_level prev;
   
   // Gets the page from main memory
@@ -151,12 +154,25 @@ frame_table_get_frame (void *upage, bool writable)
       pagedir_clear_page (f->owner->pagedir, f->page);
       intr_set_level (prev);
       
+      // file에 쓰려면 inode lock을 기다려야 할 수 있으므로 frame lock은
+      // 먼저 놓는다. f는 evictable이 아니어서 다른 evictor가 고르지 않고,
+      // owner는 sema_pf에 막혀 있어서 쓰기가 끝나기 전에 다시 읽지 않는다.
+      lock_release (&lock);
+      
+      // file 길이나 block 할당이 바뀔 수 있으므로 journal operation 안에서 쓴다.
       if(dirty && f->writable)
-        if(file_write_at ((struct file *)p->location, f->address, p->read_b, p->ofs) != (int)p->read_b)
-          thread_exit ();
+      {
+        journal_begin ();
+        written = file_write_at ((struct file *)p->location, f->address, p->read_b, p->ofs) == (int)p->read_b;
+        journal_end ();
+      }
       
       // continue normally 
+      // 쓰기에 실패해도 owner는 깨워주고 나서 종료해야 한다.
+      // 그렇지 않으면 owner가 다음 page fault에서 영원히 기다린다.
       sema_up (&f->owner->sema_pf);
+      if(!written)
+        thread_exit ();
     }
     else
     {
@@ -172,10 +188,10 @@ frame_table_get_frame (void *upage, bool writable)
       
       // continue normally 
       sema_up (&f->owner->sema_pf);
+      
+      lock_release (&lock);
     }
     
-    lock_release (&lock);
-    
     // Fills with zeros the chose frame
     memset (f->address, 0, PGSIZE);
     
@@ -211,7 +227,7 @@ frame_table_choose_victim ()
     while(true)
     {
       f = list_entry (victim_frame, struct frame, elem);
-      if(f->evictable)
+      if(f->evictable && !f->pinned)
       {
         if(!pagedir_is_accessed (f->owner->pagedir, f->page))
         {
@@ -243,6 +259,42 @@ frame_table_choose_victim ()
   return NULL;
 }
 
+/* Pins the frame holding user page UPAGE of the current thread.
+   The evictor chooses a victim and unmaps it while holding the
+   frame lock, so a page that is still mapped here has not been
+   chosen, and once pinned it will not be. */
+void *
+frame_table_pin (const void *upage)
+{
+  struct frame *f;
+  void *kpage;
+
+  lock_acquire (&lock);
+  kpage = pagedir_get_page (thread_current ()->pagedir, upage);
+  if (kpage != NULL)
+  {
+    f = frame_table_look_up (kpage);
+    if (f != NULL)
+      f->pinned = true;
+  }
+  lock_release (&lock);
+
+  return kpage;
+}
+
+/* Unpins the frame at kernel address KPAGE */
+void
+frame_table_unpin (void *kpage)
+{
+  struct frame *f;
+
+  lock_acquire (&lock);
+  f = frame_table_look_up (kpage);
+  if (f != NULL)
+    f->pinned = false;
+  lock_release (&lock);
+}
+
 /* Removes a frame from the frame table */
 void 
 frame_table_remove (struct frame *f)
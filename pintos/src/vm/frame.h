@@ -28,6 +28,9 @@ struct frame {
   
   bool writable;          /* Indicates if this frame is writable */
   
+  bool pinned;            /* A system call is doing I/O straight into or
+                             out of this frame, so it must not be evicted */
+  
   struct list_elem elem;  /* List element to be listed in the frame table */
 };
 
@@ -92,6 +95,17 @@ struct frame* frame_table_get_frame (void *, bool);
  */
 struct frame *frame_table_choose_victim (void);
 
+/*
+ * Pins the frame that holds the current thread's user page UPAGE
+ * so that it is not evicted until frame_table_unpin() is called,
+ * and returns the frame's kernel address.  Returns NULL if the
+ * page is not present; the caller should fault it in and retry.
+ */
+void *frame_table_pin (const void *);
+
+/* Undoes frame_table_pin() for the frame at the given kernel address */
+void frame_table_unpin (void *);
+
 /*Removes a frame in the frame_table*/
 void frame_table_remove (struct frame*);
 
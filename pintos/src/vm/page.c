@@ -7,6 +7,7 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/journal.h"
 #include <stdio.h>
 #include "threads/palloc.h"
 #include "userprog/pagedir.h"
@@ -23,18 +24,18 @@ supplemental_table_look_up (uint8_t *vm_addr)
   
   cur = thread_current ();
   
-  lock_acquire (&cur->lock_spt);
+  rwlock_acquire_shared (&cur->lock_spt);
   for(e=list_begin (&cur->sup_page_table); e!=list_end (&cur->sup_page_table);
   e=list_next (e))
   {
     res = list_entry (e, struct page, elem);
     if (res->page == vm_addr)
     {
-      lock_release (&cur->lock_spt);
+      rwlock_release_shared (&cur->lock_spt);
       return res;
     }
   }
-  lock_release (&cur->lock_spt);
+  rwlock_release_shared (&cur->lock_spt);
   
   return NULL;
 }
@@ -46,18 +47,18 @@ supplemental_table_look_up_ext (uint8_t *vm_addr, struct thread *cur)
   struct list_elem *e;
   struct page *res = NULL;
   
-  lock_acquire (&cur->lock_spt);
+  rwlock_acquire_shared (&cur->lock_spt);
   for(e=list_begin (&cur->sup_page_table); e!=list_end (&cur->sup_page_table);
       e=list_next (e))
   {
     res = list_entry (e, struct page, elem);
     if (res->page == vm_addr)
     {
-      lock_release (&cur->lock_spt);
+      rwlock_release_shared (&cur->lock_spt);
       return res;
     }
   }
-  lock_release (&cur->lock_spt);
+  rwlock_release_shared (&cur->lock_spt);
   
   return NULL;
 }
@@ -66,9 +67,9 @@ supplemental_table_look_up_ext (uint8_t *vm_addr, struct thread *cur)
 void
 supplemental_table_free_page (struct page *pg)
 {
-  lock_acquire (&thread_current ()-> lock_spt);
+  rwlock_acquire_exclusive (&thread_current ()-> lock_spt);
   list_remove (&pg->elem);
-  lock_release (&thread_current ()-> lock_spt);
+  rwlock_release_exclusive (&thread_current ()-> lock_spt);
 
   free (pg);
 }
@@ -171,9 +172,9 @@ supplemental_table_add_frame (struct frame *f, struct slot *s)
   p->location = s;
   p->pg = PAG_SWAP;
   
-  lock_acquire (&old_owner->lock_spt);
+  rwlock_acquire_exclusive (&old_owner->lock_spt);
   list_push_front (&old_owner->sup_page_table, &p->elem);
-  lock_release (&old_owner->lock_spt);
+  rwlock_release_exclusive (&old_owner->lock_spt);
 }
 
 
@@ -184,7 +185,7 @@ supplemental_table_destroy ()
   struct list_elem *e;
   struct page *p;
   
-  lock_acquire (&cur->lock_spt);
+  rwlock_acquire_exclusive (&cur->lock_spt);
   
   while(!list_empty (&cur->sup_page_table))
   {
@@ -195,7 +196,7 @@ supplemental_table_destroy ()
     free (p);
   }
   
-  lock_release (&cur->lock_spt);
+  rwlock_release_exclusive (&cur->lock_spt);
 }
 
 void
@@ -209,6 +210,7 @@ mf_table_destroy ()
   void *addr;
   struct page *p;
   uint32_t write_b;
+  bool written;
   
   cur = thread_current ();
   
@@ -230,26 +232,30 @@ mf_table_destroy ()
       }
       
       write_b = p->read_b;
+      written = true;
         
-      lock_acquire (&cur->lock_spt);
+      // journal_begin()은 commit을 기다릴 수 있으므로 lock보다 먼저 부른다.
+      journal_begin ();
+      rwlock_acquire_exclusive (&cur->lock_spt);
       
       kpage = pagedir_get_page (cur->pagedir, p->page);
       
       if(kpage != NULL)
       {
         if(pagedir_is_dirty (cur->pagedir, p->page))
-        {
-          if(file_write_at (mf->file, kpage, write_b, p->ofs) != (int)write_b)
-          {
-            printf ("WTF unmap? writing\n");
-            thread_exit ();
-          }
-        }
+          written = file_write_at (mf->file, kpage, write_b, p->ofs) == (int)write_b;
         
         pagedir_clear_page (cur->pagedir, mf->addr);
       }
       
-      lock_release (&thread_current ()->lock_spt);
+      rwlock_release_exclusive (&thread_current ()->lock_spt);
+      journal_end ();
+      
+      if(!written)
+      {
+        printf ("WTF unmap? writing\n");
+        thread_exit ();
+      }
       
       supplemental_table_free_page (p);
       
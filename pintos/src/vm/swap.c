@@ -40,10 +40,6 @@ void swap_init()
 /* We are going to write BUFFER (ideally a frame whose size is PGSIZE)
    to a free swap slot, it may be in the free swap table or in the slot pool*/
 struct slot* write_swap(void *buffer){
-  void * b = malloc(DISK_SECTOR_SIZE);
-  if(b == NULL)
-    PANIC("couldn't allocate buffer");
-
   struct slot * s;
   bool increment = true;  // Thus we know if we have to increment CNT
   
@@ -65,45 +61,20 @@ struct slot* write_swap(void *buffer){
     s->start = cnt;
   }
   
-  disk_sector_t i = 0, j= 0, sector = s->start;
-  uint32_t offset;
-  
-  while(j < PGSIZE)
-  {
-	// Move to the correct position within the frame
-    offset = (uint32_t)buffer + (i*DISK_SECTOR_SIZE);
-    memcpy(b, (uint8_t *)offset, DISK_SECTOR_SIZE);
-    disk_write(partition, sector++, b);
-    i++;
-    j += DISK_SECTOR_SIZE;
-  }
+  // The whole frame goes out in one multi-sector command
+  disk_write_multiple(partition, s->start, buffer, size, DISK_IO_SWAP);
 
   if(increment)
-    cnt = sector;
+    cnt = s->start + size;
 
-  free(b);
   return s;
 }
 
 void read_swap(void *buffer, struct slot* s)
 {
-  void * b = malloc(DISK_SECTOR_SIZE);
-  if(b == NULL)
-    PANIC("couldn't allocate buffer");
-
-  disk_sector_t i = 0, j= 0, sector = s->start;
-  uint32_t offset;
-  
-  while(j < PGSIZE)
-  {
-    disk_read(partition, sector++, b);
-    offset = (uint32_t)buffer + (i*DISK_SECTOR_SIZE);
-    memcpy((uint8_t *)offset, b, DISK_SECTOR_SIZE);
-    i++;
-    j += DISK_SECTOR_SIZE;
-  }
+  // The whole frame comes in with one multi-sector command
+  disk_read_multiple(partition, s->start, buffer, size, DISK_IO_SWAP);
 
-  free(b);
   free_slot(s);
 }
 